@@ -0,0 +1,41 @@
+#!/bin/sh
+#
+# Runs the scheduler micro-benchmarks (coursework-user/schedbench) under each
+# scheduling algorithm, and collects the results.
+#
+# Usage: ./bench.sh [algorithm ...]
+#
+# The benchmarks run under plain QEMU (TCG), so that the results are comparable on
+# any Linux machine.  Results are written to bench_output.txt, as the BENCH lines
+# printed by the benchmark, prefixed by the algorithm name.
+
+TOP=`pwd`
+INFOS_DIRECTORY=$TOP/infos
+ROOTFS=$TOP/infos-user/bin/rootfs.tar
+KERNEL=$INFOS_DIRECTORY/out/infos-kernel
+QEMU=qemu-system-x86_64
+OUTPUT=$TOP/bench_output.txt
+TIMEOUT=120
+
+ALGORITHMS="$*"
+if [ -z "$ALGORITHMS" ]; then
+    ALGORITHMS="rr cfs prio mlfq stride edf group"
+fi
+
+# Make the benchmark available to the user-space build, in the same way the
+# coursework is made available to the kernel build.
+ln -sfn $TOP/coursework-user/schedbench $TOP/infos-user/schedbench
+
+./build.sh || exit 1
+
+rm -f $OUTPUT
+
+for ALGORITHM in $ALGORITHMS; do
+    KERNEL_CMDLINE="boot-device=ata0 init=/usr/schedbench pgalloc.algorithm=buddy sched.debug=0 sched.algorithm=$ALGORITHM syslog=serial"
+
+    echo "Running benchmarks with sched.algorithm=$ALGORITHM..."
+
+    timeout $TIMEOUT $QEMU -kernel $KERNEL -m 512M -nographic -serial stdio -monitor none \
+        -debugcon file:/dev/null -hda $ROOTFS -append "$KERNEL_CMDLINE" 2>&1 | \
+        sed -n "s/^.*\(BENCH .*\)$/$ALGORITHM \1/p" | tee -a $OUTPUT
+done
@@ -13,3 +13,8 @@ make -C $BASE_DIR/infos-user || exit 1
 echo "Creating infos user-space hard-disk image..."
 
 make -C $BASE_DIR/infos-user fs || exit 1
+
+echo "Indexing infos user-space hard-disk image..."
+
+make -C $BASE_DIR/tarfs-index || exit 1
+$BASE_DIR/tarfs-index/tarfs-index $BASE_DIR/infos-user/bin/rootfs.tar || exit 1
@@ -0,0 +1,276 @@
+/*
+ * Scheduler Micro-benchmarks
+ *
+ * Usage: schedbench [pingpong|yield|fair|wake] [threads]
+ *
+ * With no arguments, every benchmark is run.  Each result is printed as a single line
+ * of the form:
+ *
+ *   BENCH name=<benchmark> key=value key=value ...
+ *
+ * so that results from runs under different scheduling algorithms can be collected with
+ * a simple grep.  All times are in nanoseconds.
+ */
+#include <infos.h>
+
+// The number of round trips made by the ping-pong benchmark.
+#define PINGPONG_ROUNDS		2000
+
+// How long (in microseconds) the yield and fairness benchmarks run for.
+#define RUN_TIME		2000000
+
+// The number of sleeps made by the wake-up latency benchmark, and the requested sleep.
+#define WAKE_ROUNDS		200
+#define WAKE_SLEEP		1000
+
+#define MAX_THREADS		32
+#define DEFAULT_THREADS		4
+
+/**
+ * Reads the CPU timestamp counter.
+ */
+static inline unsigned long rdtsc()
+{
+	unsigned int lo, hi;
+	asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+
+	return ((unsigned long) hi << 32) | lo;
+}
+
+// The timestamp counter frequency, in ticks per millisecond, and the counter's value
+// when it was calibrated, which times are measured from.
+static unsigned long tsc_per_ms, tsc_base;
+
+/**
+ * Calibrates the timestamp counter against the kernel's sleep.
+ */
+static void calibrate()
+{
+	unsigned long start = rdtsc();
+	usleep(100000);
+
+	tsc_base = rdtsc();
+	tsc_per_ms = (tsc_base - start) / 100;
+	if (tsc_per_ms == 0) tsc_per_ms = 1;
+}
+
+/**
+ * Returns the time since calibration, in nanoseconds.
+ */
+static unsigned long now_ns()
+{
+	// Whole milliseconds and the remainder are converted separately, so that the
+	// multiplication cannot overflow however long the benchmarks run.
+	unsigned long ticks = rdtsc() - tsc_base;
+	return ((ticks / tsc_per_ms) * 1000000) + (((ticks % tsc_per_ms) * 1000000) / tsc_per_ms);
+}
+
+/**
+ * Gives up the CPU to any other runnable thread.
+ */
+static inline void yield()
+{
+	usleep(0);
+}
+
+static volatile bool stop;
+static volatile unsigned long counters[MAX_THREADS];
+
+/*
+ * Ping-pong: two threads take turns, handing over with a shared flag.  Each hand-over
+ * requires a context switch, so the round-trip time is twice the switch latency.
+ */
+static volatile int turn;
+
+static void pingpong_partner(void *arg)
+{
+	for (int i = 0; i < PINGPONG_ROUNDS; i++) {
+		while (turn != 1) yield();
+		turn = 0;
+	}
+}
+
+static void bench_pingpong()
+{
+	turn = 0;
+	HTHREAD partner = create_thread(pingpong_partner, NULL);
+
+	unsigned long start = now_ns();
+	for (int i = 0; i < PINGPONG_ROUNDS; i++) {
+		turn = 1;
+		while (turn != 0) yield();
+	}
+	unsigned long elapsed = now_ns() - start;
+
+	join_thread(partner);
+
+	printf("BENCH name=pingpong rounds=%u total=%lu round_trip=%lu switch=%lu\n",
+		PINGPONG_ROUNDS, elapsed, elapsed / PINGPONG_ROUNDS, elapsed / (PINGPONG_ROUNDS * 2));
+}
+
+/*
+ * Yield throughput: N threads yield to each other as fast as they can.
+ */
+static void yield_thread(void *arg)
+{
+	unsigned long index = (unsigned long) arg;
+
+	while (!stop) {
+		counters[index]++;
+		yield();
+	}
+}
+
+/*
+ * Fairness: N threads spin, counting how much CPU time they get.
+ */
+static void spin_thread(void *arg)
+{
+	unsigned long index = (unsigned long) arg;
+
+	while (!stop) {
+		counters[index]++;
+	}
+}
+
+/**
+ * Runs 'nr_threads' copies of a thread for RUN_TIME, and returns the elapsed time.
+ */
+static unsigned long run_threads(ThreadProc proc, int nr_threads)
+{
+	HTHREAD threads[MAX_THREADS];
+
+	stop = false;
+	for (int i = 0; i < nr_threads; i++) {
+		counters[i] = 0;
+	}
+
+	unsigned long start = now_ns();
+	for (int i = 0; i < nr_threads; i++) {
+		threads[i] = create_thread(proc, (void *) (unsigned long) i);
+	}
+
+	usleep(RUN_TIME);
+	stop = true;
+
+	for (int i = 0; i < nr_threads; i++) {
+		join_thread(threads[i]);
+	}
+
+	return now_ns() - start;
+}
+
+static void bench_yield(int nr_threads)
+{
+	unsigned long elapsed = run_threads(yield_thread, nr_threads);
+
+	unsigned long total = 0;
+	for (int i = 0; i < nr_threads; i++) {
+		total += counters[i];
+	}
+
+	printf("BENCH name=yield threads=%d total=%lu elapsed=%lu per_yield=%lu\n",
+		nr_threads, total, elapsed, total ? elapsed / total : 0);
+}
+
+static void bench_fair(int nr_threads)
+{
+	run_threads(spin_thread, nr_threads);
+
+	unsigned long total = 0, min = ~0UL, max = 0;
+	for (int i = 0; i < nr_threads; i++) {
+		total += counters[i];
+		if (counters[i] < min) min = counters[i];
+		if (counters[i] > max) max = counters[i];
+	}
+
+	// Jain's fairness index, (sum x)^2 / (n * sum x^2), scaled by 1000 so that 1000 is
+	// perfectly fair.  The counters are scaled down first to avoid overflow.
+	unsigned long sum = 0, sum_sq = 0;
+	for (int i = 0; i < nr_threads; i++) {
+		unsigned long x = counters[i] / 1024;
+		sum += x;
+		sum_sq += x * x;
+	}
+
+	unsigned long mean = total / nr_threads;
+	printf("BENCH name=fair threads=%d total=%lu min=%lu max=%lu spread_pct=%lu jain_x1000=%lu\n",
+		nr_threads, total, min, max, mean ? ((max - min) * 100) / mean : 0,
+		sum_sq ? (sum * sum * 1000) / (nr_threads * sum_sq) : 0);
+
+	for (int i = 0; i < nr_threads; i++) {
+		printf("BENCH name=fair-share thread=%d count=%lu share_pct=%lu\n",
+			i, counters[i], total ? (counters[i] * 100) / total : 0);
+	}
+}
+
+/*
+ * Wake-up latency: sleep for a short time, and measure how late the thread starts
+ * running again.  The other threads keep the CPU busy meanwhile.
+ */
+static void bench_wake(int nr_threads)
+{
+	HTHREAD threads[MAX_THREADS];
+
+	stop = false;
+	for (int i = 0; i < nr_threads; i++) {
+		threads[i] = create_thread(spin_thread, (void *) (unsigned long) i);
+	}
+
+	unsigned long total = 0, min = ~0UL, max = 0;
+	for (int i = 0; i < WAKE_ROUNDS; i++) {
+		unsigned long start = now_ns();
+		usleep(WAKE_SLEEP);
+
+		unsigned long slept = now_ns() - start;
+		unsigned long late = slept > WAKE_SLEEP * 1000UL ? slept - WAKE_SLEEP * 1000UL : 0;
+
+		total += late;
+		if (late < min) min = late;
+		if (late > max) max = late;
+	}
+
+	stop = true;
+	for (int i = 0; i < nr_threads; i++) {
+		join_thread(threads[i]);
+	}
+
+	printf("BENCH name=wake threads=%d rounds=%u sleep=%lu min=%lu avg=%lu max=%lu\n",
+		nr_threads, WAKE_ROUNDS, WAKE_SLEEP * 1000UL, min, total / WAKE_ROUNDS, max);
+}
+
+/**
+ * Parses the thread count argument, which follows the benchmark name.
+ */
+static int parse_threads(const char *cmdline)
+{
+	while (*cmdline && *cmdline != ' ') cmdline++;
+	while (*cmdline == ' ') cmdline++;
+
+	int n = 0;
+	while (*cmdline >= '0' && *cmdline <= '9') {
+		n = (n * 10) + (*cmdline++ - '0');
+	}
+
+	if (n <= 0) return DEFAULT_THREADS;
+	return n > MAX_THREADS ? MAX_THREADS : n;
+}
+
+int main(const char *cmdline)
+{
+	if (!cmdline) cmdline = "";
+
+	int nr_threads = parse_threads(cmdline);
+	bool all = *cmdline == 0;
+
+	calibrate();
+	printf("BENCH name=calibrate tsc_per_ms=%lu\n", tsc_per_ms);
+
+	if (all || strncmp(cmdline, "pingpong", 8) == 0) bench_pingpong();
+	if (all || strncmp(cmdline, "yield", 5) == 0) bench_yield(nr_threads);
+	if (all || strncmp(cmdline, "fair", 4) == 0) bench_fair(nr_threads);
+	if (all || strncmp(cmdline, "wake", 4) == 0) bench_wake(nr_threads);
+
+	printf("BENCH name=done\n");
+	return 0;
+}
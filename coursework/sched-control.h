@@ -0,0 +1,177 @@
+/*
+ * Scheduling Algorithm Control Interface
+ */
+#ifndef SCHED_CONTROL_H
+#define SCHED_CONTROL_H
+
+#include <infos/kernel/sched-entity.h>
+
+namespace infos {
+	namespace kernel {
+		class Process;
+	}
+}
+
+// The number of distinct priority levels supported by the "prio" algorithm.  Level
+// zero is the most urgent.  This must not exceed the width of the level bitmap.
+#define SCHED_NR_PRIORITIES	64
+
+// The number of buckets in the "rr" algorithm's wake-to-run latency histogram.
+#define SCHED_LATENCY_BUCKETS	20
+
+namespace sched {
+
+	/**
+	 * The accounting kept for each entity by the "rr" algorithm.  Times are in
+	 * nanoseconds.
+	 */
+	struct EntitySchedStats {
+		// The total time the entity has spent waiting on a runqueue, and running.
+		uint64_t wait_time, run_time;
+
+		// The number of times the entity gave up the CPU by itself (e.g. by blocking),
+		// and the number of times it was preempted.
+		unsigned long nr_voluntary, nr_involuntary;
+
+		// The timeslice the entity currently gets each time it is picked.
+		uint64_t timeslice;
+
+		// The number of times the entity has moved to a different CPU.
+		unsigned long nr_migrations;
+	};
+
+	/**
+	 * Retrieves the "rr" algorithm's accounting for an entity.
+	 * @param entity The entity to retrieve the accounting for.
+	 * @param stats Receives the accounting.
+	 * @return Returns TRUE if the entity is known to the algorithm.
+	 */
+	extern bool get_entity_stats(infos::kernel::SchedulingEntity& entity, EntitySchedStats& stats);
+
+	/**
+	 * Retrieves the "rr" algorithm's wake-to-run latency histogram, summed over all CPUs.
+	 * Bucket i counts entities that started running less than 2^i microseconds after
+	 * becoming runnable (the last bucket also counts everything slower).
+	 * @param buckets Receives SCHED_LATENCY_BUCKETS counts.
+	 */
+	extern void get_wakeup_latency(unsigned long *buckets);
+
+	/**
+	 * Changes the priority level of an entity under the "prio" algorithm.  The change
+	 * takes effect immediately, even if the entity is already runnable.
+	 * @param entity The entity to change the priority of.
+	 * @param level The new priority level, where zero is the most urgent.
+	 * @return Returns TRUE if the priority was changed, FALSE if the level was out of
+	 * range or the scheduler has not seen the entity yet.
+	 */
+	extern bool set_priority(infos::kernel::SchedulingEntity& entity, unsigned int level);
+
+	/**
+	 * Returns the current priority level of an entity under the "prio" algorithm.
+	 */
+	extern unsigned int get_priority(infos::kernel::SchedulingEntity& entity);
+
+	/**
+	 * The CPU accounting kept for each entity by the "stride" algorithm.
+	 */
+	struct StrideStats {
+		// The entity's configured share, as a number of tickets.
+		unsigned int tickets;
+
+		// The total CPU time (in nanoseconds) the entity has been charged, and the
+		// number of times it has been picked to run.
+		uint64_t runtime;
+		unsigned long picks;
+	};
+
+	/**
+	 * Sets the number of tickets an entity holds under the "stride" algorithm.  Each
+	 * runnable entity receives CPU time in proportion to its tickets.
+	 * @param entity The entity to change the tickets of.
+	 * @param tickets The new number of tickets, which must be non-zero.
+	 * @return Returns TRUE if the tickets were changed, or FALSE if the count is out of
+	 * range or the scheduler has not seen the entity yet.
+	 */
+	extern bool set_tickets(infos::kernel::SchedulingEntity& entity, unsigned int tickets);
+
+	/**
+	 * Retrieves the "stride" algorithm's accounting for an entity.
+	 * @param entity The entity to retrieve the accounting for.
+	 * @param stats Receives the accounting.
+	 * @return Returns TRUE if the entity is known to the algorithm.
+	 */
+	extern bool get_stride_stats(infos::kernel::SchedulingEntity& entity, StrideStats& stats);
+
+	/**
+	 * Places an entity in the real-time class of the "edf" algorithm.  In every period,
+	 * the entity is guaranteed up to 'runtime' of CPU time before its deadline, ahead of
+	 * any entity in the normal class.  The request is rejected if the total bandwidth of
+	 * the real-time class would exceed the admission limit, where each entity's
+	 * bandwidth is its density: 'runtime' divided by 'deadline'.
+	 * @param entity The entity to make real-time.
+	 * @param runtime The CPU time (in nanoseconds) the entity needs in each period.
+	 * @param period The period (in nanoseconds) at which the entity is released.
+	 * @param deadline The deadline (in nanoseconds) relative to each release.  This must
+	 * lie between 'runtime' and 'period'.
+	 * @return Returns TRUE if the entity was admitted, or FALSE if it was rejected or
+	 * the scheduler has not seen the entity yet.
+	 */
+	extern bool set_deadline(infos::kernel::SchedulingEntity& entity, uint64_t runtime, uint64_t period, uint64_t deadline);
+
+	/**
+	 * Returns an entity from the real-time class of the "edf" algorithm to the normal
+	 * class, releasing its bandwidth.
+	 */
+	extern void clear_deadline(infos::kernel::SchedulingEntity& entity);
+
+	/**
+	 * Returns the number of deadlines an entity has missed under the "edf" algorithm.
+	 */
+	extern unsigned long get_deadline_misses(infos::kernel::SchedulingEntity& entity);
+
+	/**
+	 * The accounting kept for each group by the "group" algorithm.
+	 */
+	struct GroupStats {
+		// The group's configured weight.
+		unsigned int weight;
+
+		// The total CPU time (in nanoseconds) the group's threads have used.
+		uint64_t runtime;
+
+		// The number of threads in the group, and how many of them are runnable.
+		unsigned int nr_threads, nr_runnable;
+	};
+
+	/**
+	 * Sets the weight of a process's group under the "group" algorithm.  Each runnable
+	 * group receives CPU time in proportion to its weight, however many threads it has.
+	 * Groups start with a weight of 1024.  A process only has a group once the
+	 * scheduler has seen one of its threads, and loses it when its last thread stops.
+	 * @param process The process whose group to change.
+	 * @param weight The new weight, which must be between 1 and 65536.
+	 * @return Returns TRUE if the weight was changed, or FALSE if the weight is out of
+	 * range, or the process does not have a group.
+	 */
+	extern bool set_group_weight(infos::kernel::Process& process, unsigned int weight);
+
+	/**
+	 * Moves an entity into the group of a different process under the "group"
+	 * algorithm, e.g. to have several processes share one tenant's slice.  Entities
+	 * start in the group of the process that owns them.
+	 * @param entity The entity to move.
+	 * @param process The process whose group the entity should join.
+	 * @return Returns TRUE if the entity was moved.
+	 */
+	extern bool set_entity_group(infos::kernel::SchedulingEntity& entity, infos::kernel::Process& process);
+
+	/**
+	 * Retrieves the "group" algorithm's accounting for a process's group.
+	 * @param process The process whose group to retrieve the accounting for.
+	 * @param stats Receives the accounting.
+	 * @return Returns TRUE if the process has a group.
+	 */
+	extern bool get_group_stats(infos::kernel::Process& process, GroupStats& stats);
+}
+
+#endif /* SCHED_CONTROL_H */
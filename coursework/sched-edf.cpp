@@ -0,0 +1,382 @@
+/*
+ * Earliest-deadline-first Scheduling Algorithm
+ */
+#include <infos/kernel/sched.h>
+#include <infos/kernel/thread.h>
+#include <infos/kernel/log.h>
+#include <infos/util/lock.h>
+
+#include "sched-runqueue.h"
+#include "sched-control.h"
+
+using namespace infos::kernel;
+using namespace infos::util;
+using namespace sched;
+
+// Bandwidth is measured in parts-per-million of one CPU.
+#define EDF_BW_UNIT		1000000ULL
+
+// The most bandwidth the real-time class may reserve, leaving the rest of the CPU to
+// the normal class.
+#define EDF_MAX_BANDWIDTH	(EDF_BW_UNIT * 95 / 100)
+
+/**
+ * An earliest-deadline-first scheduling algorithm, with two classes.  Entities in the
+ * real-time class have a (runtime, period, deadline) reservation, and the one with the
+ * earliest absolute deadline always runs first.  An entity that exhausts its runtime
+ * is throttled until its next period.  Entities in the normal class are run round-robin,
+ * but only when no real-time entity is eligible.
+ */
+class EDFScheduler : public SchedulingAlgorithm
+{
+public:
+	EDFScheduler() : current(NULL), nr_realtime(0), total_bandwidth(0), nr_missed(0)
+	{
+	  instance = this;
+	}
+
+	/**
+	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
+	 */
+	const char* name() const override { return "edf"; }
+
+	/**
+	 * Called when a scheduling entity becomes eligible for running.
+	 * @param entity
+	 */
+	void add_to_runqueue(SchedulingEntity& entity) override
+	{
+	  UniqueIRQLock l;
+
+	  EDFEntity *record = entities.get_or_create(entity);
+	  if (!record) {
+	    refuse_entity("edf", entity);
+	    return;
+	  }
+
+	  if (record->runnable) return;
+	  record->runnable = true;
+
+	  if (!record->realtime) {
+	    normal.enqueue(*record);
+	    return;
+	  }
+
+	  // The CBS wakeup rule: a job carries on with what is left of its current
+	  // reservation only if running the rest of its budget before its deadline stays
+	  // within its reserved bandwidth.  Otherwise, including when the deadline has
+	  // passed, it starts a new job now, so that an entity that slept cannot use its
+	  // leftover budget to take more than its share before an old deadline.
+	  uint64_t now = sched::now();
+	  if (now >= record->abs_deadline
+	      || (record->budget > 0
+	          && (uint64_t) record->budget > ((record->abs_deadline - now) * record->bandwidth) / EDF_BW_UNIT)) {
+	    start_job(*record, now);
+	  }
+
+	  place(*record);
+	}
+
+	/**
+	 * Called when a scheduling entity is no longer eligible for running.
+	 * @param entity
+	 */
+	void remove_from_runqueue(SchedulingEntity& entity) override
+	{
+	  UniqueIRQLock l;
+
+	  EDFEntity *record = entities.get(entity);
+	  if (!record) return;
+
+	  if (record == current) {
+	    charge(*record);
+	    current = NULL;
+	  }
+
+	  unlink(*record);
+	  record->runnable = false;
+
+	  // A stopped entity will never be added back, so give up its reservation and record.
+	  if (entity.stopped()) {
+	    if (record->realtime) {
+	      total_bandwidth -= record->bandwidth;
+	      nr_realtime--;
+	    }
+
+	    entities.release(record);
+	  }
+	}
+
+	/**
+	 * Called every time a scheduling event occurs, to cause the next eligible entity
+	 * to be chosen.  This is the eligible real-time entity with the earliest deadline,
+	 * or failing that, the next normal entity in round-robin order.
+	 */
+	SchedulingEntity *pick_next_entity() override
+	{
+	  uint64_t now = sched::now();
+
+	  if (current) charge(*current);
+
+	  replenish(now);
+
+	  // A job still holding runtime at its deadline has missed it.  Count the miss, and
+	  // move the job on to its next period.
+	  EDFEntity *next;
+	  while ((next = deadlines.first()) && next->abs_deadline <= now) {
+	    next->nr_missed++;
+	    nr_missed++;
+
+	    sched_log.messagef(LogLevel::DEBUG, "edf: entity=%p missed its deadline (misses=%lu)", next->entity, next->nr_missed);
+
+	    next->release += next->period;
+	    next->abs_deadline = next->release + next->deadline;
+	    next->budget = next->runtime;
+	    deadlines.update(*next);
+	  }
+
+	  // The normal entity that is picked moves to the tail of its runqueue, so the next
+	  // normal pick is the one after it, even if real-time entities ran in between.
+	  if (!next && !normal.empty()) {
+	    next = static_cast<EDFEntity *>(normal.rotate());
+	  }
+
+	  if (next && next != current) next->runtime_mark = runtime_of(*next->entity);
+
+	  current = next;
+	  return next ? next->entity : NULL;
+	}
+
+	/**
+	 * Admits an entity to the real-time class.
+	 */
+	bool set_deadline(SchedulingEntity& entity, uint64_t runtime, uint64_t period, uint64_t deadline)
+	{
+	  if (runtime == 0 || runtime > deadline || deadline > period) return false;
+
+	  UniqueIRQLock l;
+
+	  // Only entities that have already been runnable can be admitted.  Records are
+	  // released when their entity stops, so one created here for an entity that never
+	  // runs would be leaked.
+	  EDFEntity *record = entities.get(entity);
+	  if (!record) return false;
+
+	  // Admission control: the total density (runtime / deadline) of the real-time class
+	  // must stay within the limit.  A total density of at most one CPU is enough for
+	  // EDF to meet every deadline, even when deadlines are shorter than periods; the
+	  // utilisation (runtime / period) is not, as it understates the demand of such an
+	  // entity.  Since the deadline is never longer than the period, this is also at
+	  // least the share of the CPU the entity may take.
+	  uint64_t bandwidth = (runtime * EDF_BW_UNIT) / deadline;
+	  uint64_t others = total_bandwidth - (record->realtime ? record->bandwidth : 0);
+
+	  if (others + bandwidth > EDF_MAX_BANDWIDTH) {
+	    sched_log.messagef(LogLevel::DEBUG, "edf: rejected entity=%p, bandwidth=%lu reserved=%lu", &entity, bandwidth, others);
+	    return false;
+	  }
+
+	  // Every real-time entity has room kept for it in the deadline heap, so that
+	  // placing one there never fails.
+	  if (!record->realtime) {
+	    if (!deadlines.reserve(nr_realtime + 1)) return false;
+	    nr_realtime++;
+	  }
+
+	  unlink(*record);
+
+	  total_bandwidth = others + bandwidth;
+	  record->realtime = true;
+	  record->bandwidth = bandwidth;
+	  record->runtime = runtime;
+	  record->period = period;
+	  record->deadline = deadline;
+
+	  uint64_t now = sched::now();
+	  start_job(*record, now);
+
+	  if (record->runnable) place(*record);
+	  return true;
+	}
+
+	/**
+	 * Returns an entity to the normal class.
+	 */
+	void clear_deadline(SchedulingEntity& entity)
+	{
+	  UniqueIRQLock l;
+
+	  EDFEntity *record = entities.get(entity);
+	  if (!record || !record->realtime) return;
+
+	  unlink(*record);
+
+	  total_bandwidth -= record->bandwidth;
+	  nr_realtime--;
+	  record->realtime = false;
+	  record->bandwidth = 0;
+
+	  if (record->runnable) normal.enqueue(*record);
+	}
+
+	/**
+	 * Returns the number of deadlines an entity has missed.
+	 */
+	unsigned long get_misses(SchedulingEntity& entity)
+	{
+	  UniqueIRQLock l;
+
+	  EDFEntity *record = entities.get(entity);
+	  return record ? record->nr_missed : 0;
+	}
+
+	// The registered instance of this algorithm.
+	static EDFScheduler *instance;
+
+private:
+	/**
+	 * The per-entity state kept by the EDF scheduler.  The runqueue links are used for
+	 * either the normal class runqueue, or the throttled list.
+	 */
+	struct EDFEntity : public EntityRecord, public HeapNode {
+	  EDFEntity()
+	    : runnable(false), realtime(false), runtime(0), period(0), deadline(0), bandwidth(0),
+	      release(0), abs_deadline(0), budget(0), runtime_mark(0), nr_missed(0) { }
+
+	  bool runnable, realtime;
+
+	  // The reservation, and its density (runtime / deadline) in bandwidth units.
+	  uint64_t runtime, period, deadline, bandwidth;
+
+	  // The current job: its release time, absolute deadline and remaining runtime.
+	  uint64_t release, abs_deadline;
+	  int64_t budget;
+
+	  // The entity's total CPU time when it was last charged.
+	  uint64_t runtime_mark;
+
+	  unsigned long nr_missed;
+	};
+
+	static bool earlier(const EDFEntity *a, const EDFEntity *b)
+	{
+	  return a->abs_deadline < b->abs_deadline;
+	}
+
+	/**
+	 * Starts a new job for a real-time entity, released at the given time.
+	 */
+	static void start_job(EDFEntity& record, uint64_t now)
+	{
+	  record.release = now;
+	  record.abs_deadline = now + record.deadline;
+	  record.budget = record.runtime;
+	}
+
+	/**
+	 * Puts a runnable real-time entity in the deadline heap, or on the throttled list if
+	 * it has no runtime left in this period.
+	 */
+	void place(EDFEntity& record)
+	{
+	  if (record.budget > 0) {
+	    deadlines.insert(record);
+	  } else {
+	    throttled.enqueue(record);
+	  }
+	}
+
+	/**
+	 * Takes an entity off whichever runqueue it is on.
+	 */
+	void unlink(EDFEntity& record)
+	{
+	  if (record.in_heap()) deadlines.remove(record);
+	  if (record.queued()) {
+	    if (record.realtime) {
+	      throttled.remove(record);
+	    } else {
+	      normal.remove(record);
+	    }
+	  }
+	}
+
+	/**
+	 * Charges an entity for the CPU time it has used since it was last charged.  A
+	 * real-time entity that has used up its runtime is throttled.
+	 */
+	void charge(EDFEntity& record)
+	{
+	  uint64_t runtime = runtime_of(*record.entity);
+	  uint64_t used = runtime - record.runtime_mark;
+	  record.runtime_mark = runtime;
+
+	  if (!record.realtime) return;
+
+	  record.budget -= used;
+	  if (record.budget <= 0 && record.in_heap()) {
+	    deadlines.remove(record);
+	    throttled.enqueue(record);
+	  }
+	}
+
+	/**
+	 * Gives throttled entities whose next period has started a fresh runtime, and makes
+	 * them eligible again.
+	 */
+	void replenish(uint64_t now)
+	{
+	  RunqueueNode *node = throttled.first();
+
+	  while (node) {
+	    EDFEntity *record = static_cast<EDFEntity *>(node);
+	    node = Runqueue::next(*node);
+
+	    uint64_t next_release = record->release + record->period;
+	    if (now < next_release) continue;
+
+	    throttled.remove(*record);
+	    start_job(*record, next_release);
+	    deadlines.insert(*record);
+	  }
+	}
+
+	// The per-entity records.
+	EntityTable<EDFEntity> entities;
+
+	// Eligible real-time entities, ordered by absolute deadline.
+	IndexedHeap<EDFEntity, earlier> deadlines;
+
+	// Real-time entities waiting for their next period, and the normal class.
+	Runqueue throttled, normal;
+
+	// The entity that was picked last time.
+	EDFEntity *current;
+
+	// The number of entities in the real-time class, which the deadline heap always has
+	// room for.
+	unsigned int nr_realtime;
+
+	// The bandwidth reserved by the real-time class, and the total deadline misses.
+	uint64_t total_bandwidth;
+	unsigned long nr_missed;
+};
+
+EDFScheduler *EDFScheduler::instance;
+
+bool sched::set_deadline(SchedulingEntity& entity, uint64_t runtime, uint64_t period, uint64_t deadline)
+{
+  return EDFScheduler::instance->set_deadline(entity, runtime, period, deadline);
+}
+
+void sched::clear_deadline(SchedulingEntity& entity)
+{
+  EDFScheduler::instance->clear_deadline(entity);
+}
+
+unsigned long sched::get_deadline_misses(SchedulingEntity& entity)
+{
+  return EDFScheduler::instance->get_misses(entity);
+}
+
+RegisterScheduler(EDFScheduler);
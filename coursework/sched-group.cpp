@@ -0,0 +1,426 @@
+/*
+ * Group Fair-share Scheduling Algorithm
+ */
+#include <infos/kernel/sched.h>
+#include <infos/kernel/thread.h>
+#include <infos/kernel/process.h>
+#include <infos/kernel/log.h>
+#include <infos/util/lock.h>
+
+#include "sched-runqueue.h"
+#include "sched-control.h"
+
+using namespace infos::kernel;
+using namespace infos::util;
+using namespace sched;
+
+// The most groups that can exist at once.  Threads of any further processes share a
+// single overflow group.
+#define GROUP_MAX_GROUPS	256
+
+// The weight of a group until it is told otherwise.  A group's virtual runtime advances
+// at real time when it has exactly this weight.
+#define GROUP_DEFAULT_WEIGHT	1024
+
+// The largest weight a group may be given.
+#define GROUP_MAX_WEIGHT	(1u << 16)
+
+// The CPU time (in nanoseconds) a thread runs for before the next thread in its group
+// gets a turn.
+#define GROUP_QUANTUM		10000000ULL
+
+// How often (in nanoseconds) the share accounting is logged.
+#define GROUP_STATS_INTERVAL	1000000000ULL
+
+/**
+ * A group fair-share scheduling algorithm.  Threads are grouped by the process that owns
+ * them (unless they have been placed in another group explicitly), and CPU time is
+ * shared out between the groups in proportion to their weights, no matter how many
+ * threads each group has.  Within a group, the runnable threads take turns.
+ *
+ * Each runnable group sits in a min-heap ordered by virtual runtime, which advances
+ * inversely to the group's weight as its threads use the CPU, so the group that is
+ * furthest behind its share always runs next.
+ */
+class GroupScheduler : public SchedulingAlgorithm
+{
+public:
+	GroupScheduler() : current(NULL), min_vruntime(0), last_stats(0)
+	{
+	  instance = this;
+	}
+
+	/**
+	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
+	 */
+	const char* name() const override { return "group"; }
+
+	/**
+	 * Called when a scheduling entity becomes eligible for running.
+	 * @param entity
+	 */
+	void add_to_runqueue(SchedulingEntity& entity) override
+	{
+	  UniqueIRQLock l;
+
+	  GroupEntity *record = get_record(entity);
+	  if (!record) {
+	    refuse_entity("group", entity);
+	    return;
+	  }
+
+	  if (record->queued()) return;
+	  enqueue(*record);
+	}
+
+	/**
+	 * Called when a scheduling entity is no longer eligible for running.
+	 * @param entity
+	 */
+	void remove_from_runqueue(SchedulingEntity& entity) override
+	{
+	  UniqueIRQLock l;
+
+	  GroupEntity *record = entities.get(entity);
+	  if (!record) return;
+
+	  if (record == current) {
+	    charge(*record);
+	    current = NULL;
+	  }
+
+	  if (record->queued()) dequeue(*record);
+
+	  // A stopped entity will never be added back, so give its record up, along with
+	  // its group if it was the last member.
+	  if (entity.stopped()) {
+	    put_group(record->group);
+	    entities.release(record);
+	  }
+	}
+
+	/**
+	 * Called every time a scheduling event occurs, to cause the next eligible entity
+	 * to be chosen.  This is the thread at the head of the group with the lowest
+	 * virtual runtime.
+	 */
+	SchedulingEntity *pick_next_entity() override
+	{
+	  uint64_t now = sched::now();
+	  if (now - last_stats >= GROUP_STATS_INTERVAL) {
+	    last_stats = now;
+	    dump_state();
+	  }
+
+	  if (current) charge(*current);
+
+	  Group *group = runnable.first();
+	  if (!group) {
+	    current = NULL;
+	    return NULL;
+	  }
+
+	  // The minimum virtual runtime never goes backwards.
+	  if ((int64_t) (group->vruntime - min_vruntime) > 0) min_vruntime = group->vruntime;
+
+	  // Take turns within the group once the thread at its head has had its quantum.
+	  GroupEntity *next = static_cast<GroupEntity *>(group->threads.first());
+	  if (next->slice_used >= GROUP_QUANTUM) {
+	    next->slice_used = 0;
+	    group->threads.rotate();
+	    next = static_cast<GroupEntity *>(group->threads.first());
+	  }
+
+	  if (next != current) {
+	    next->runtime_mark = runtime_of(*next->entity);
+	    current = next;
+	  }
+
+	  return next->entity;
+	}
+
+	/**
+	 * Changes the weight of a process's group.  A runnable group keeps its place in
+	 * the heap, and its virtual runtime advances at the new rate from now on.
+	 */
+	bool set_group_weight(Process& process, unsigned int weight)
+	{
+	  if (weight == 0 || weight > GROUP_MAX_WEIGHT) return false;
+
+	  UniqueIRQLock l;
+
+	  // A group only exists while it has members, so the group is not created here:
+	  // one made for a process with no threads would never be freed, and would outlive
+	  // the process it is keyed on.
+	  Group *group = find_group(process, false);
+	  if (!group || group == &overflow) return false;
+
+	  group->weight = weight;
+	  return true;
+	}
+
+	/**
+	 * Moves an entity into the group of a different process.
+	 */
+	bool set_entity_group(SchedulingEntity& entity, Process& process)
+	{
+	  UniqueIRQLock l;
+
+	  GroupEntity *record = get_record(entity);
+	  if (!record) return false;
+
+	  // A group created here gains the entity as its member straight away, so it is
+	  // freed in the usual way once the entity leaves it.
+	  Group *group = find_group(process, true);
+	  if (!group) return false;
+
+	  if (group == record->group) return true;
+
+	  if (record == current) charge(*record);
+
+	  bool queued = record->queued();
+	  if (queued) dequeue(*record);
+
+	  group->nr_members++;
+	  put_group(record->group);
+	  record->group = group;
+
+	  if (queued) enqueue(*record);
+	  return true;
+	}
+
+	/**
+	 * Retrieves the accounting kept for a process's group.
+	 */
+	bool get_group_stats(Process& process, GroupStats& stats)
+	{
+	  UniqueIRQLock l;
+
+	  Group *group = find_group(process, false);
+	  if (!group) return false;
+
+	  stats.weight = group->weight;
+	  stats.runtime = group->runtime;
+	  stats.nr_threads = group->nr_members;
+	  stats.nr_runnable = group->threads.count();
+
+	  return true;
+	}
+
+	/**
+	 * Logs the configured and achieved CPU share of every runnable group.
+	 */
+	void dump_state()
+	{
+	  uint64_t total_weight = 0, total_runtime = 0;
+	  for (unsigned int i = 0; i < runnable.count(); i++) {
+	    total_weight += runnable.at(i)->weight;
+	    total_runtime += runnable.at(i)->runtime;
+	  }
+
+	  if (total_weight == 0 || total_runtime == 0) return;
+
+	  for (unsigned int i = 0; i < runnable.count(); i++) {
+	    const Group *group = runnable.at(i);
+
+	    sched_log.messagef(LogLevel::DEBUG, "group: group=%p weight=%u threads=%u runnable=%u configured=%lu%% achieved=%lu%%",
+	      group->key, group->weight, group->nr_members, group->threads.count(),
+	      (group->weight * 100) / total_weight, (group->runtime * 100) / total_runtime);
+	  }
+	}
+
+	// The registered instance of this algorithm.
+	static GroupScheduler *instance;
+
+private:
+	/**
+	 * A group of threads that share a slice of the CPU.
+	 */
+	struct Group : public HeapNode {
+	  Group() : key(NULL), weight(GROUP_DEFAULT_WEIGHT), vruntime(0), runtime(0), nr_members(0) { }
+
+	  // The process the group belongs to, or NULL if the group is free.
+	  const Process *key;
+
+	  unsigned int weight;
+	  uint64_t vruntime;
+
+	  // The total CPU time (in nanoseconds) the group's threads have used.
+	  uint64_t runtime;
+
+	  // The group's runnable threads, and the number of threads that belong to it.
+	  Runqueue threads;
+	  unsigned int nr_members;
+	};
+
+	/**
+	 * The per-entity state kept by the group scheduler.
+	 */
+	struct GroupEntity : public EntityRecord {
+	  GroupEntity() : group(NULL), runtime_mark(0), slice_used(0) { }
+
+	  Group *group;
+
+	  // The entity's total CPU time when it was last charged, and how much of its
+	  // quantum it has used.
+	  uint64_t runtime_mark, slice_used;
+	};
+
+	static bool before(const Group *a, const Group *b)
+	{
+	  // Compare with wrap-around, so that virtual runtimes may overflow safely.
+	  return (int64_t) (a->vruntime - b->vruntime) < 0;
+	}
+
+	/**
+	 * Finds the record for an entity, creating it (and placing it in its process's
+	 * group) on first sight.
+	 */
+	GroupEntity *get_record(SchedulingEntity& entity)
+	{
+	  GroupEntity *record = entities.get(entity);
+	  if (record) return record;
+
+	  // Every scheduling entity is a thread.
+	  Group *group = find_group(((Thread&) entity).owner(), true);
+	  if (!group) return NULL;
+
+	  // Do not leave a group behind that was only created for this entity.
+	  record = entities.get_or_create(entity);
+	  if (!record) {
+	    release_if_unused(group);
+	    return NULL;
+	  }
+
+	  record->group = group;
+	  record->runtime_mark = runtime_of(entity);
+	  group->nr_members++;
+
+	  return record;
+	}
+
+	/**
+	 * Finds the group that belongs to a process.  This is only needed when a thread is
+	 * first seen, so a linear search will do.
+	 * @param create TRUE if the group should be created if it does not exist.  If there
+	 * is no room for it, the overflow group is returned instead.
+	 * @return Returns the group, or NULL if it does not exist.
+	 */
+	Group *find_group(const Process& process, bool create)
+	{
+	  Group *free = NULL;
+
+	  for (unsigned int i = 0; i < GROUP_MAX_GROUPS; i++) {
+	    if (groups[i].key == &process) return &groups[i];
+	    if (!free && !groups[i].key) free = &groups[i];
+	  }
+
+	  if (!create) return NULL;
+	  if (!free) return &overflow;
+
+	  *free = Group();
+	  free->key = &process;
+	  free->vruntime = min_vruntime;
+
+	  return free;
+	}
+
+	/**
+	 * Drops a member from a group, freeing the group once it has no members left.
+	 */
+	void put_group(Group *group)
+	{
+	  assert(group->nr_members > 0);
+
+	  group->nr_members--;
+	  release_if_unused(group);
+	}
+
+	/**
+	 * Frees a group if it has no members, so that nothing refers to it any more.
+	 */
+	void release_if_unused(Group *group)
+	{
+	  if (group->nr_members == 0 && group->threads.empty() && group != &overflow) group->key = NULL;
+	}
+
+	/**
+	 * Places a thread on its group's runqueue, making the group runnable if need be.
+	 * A group that has been idle rejoins at the minimum virtual runtime, so idling does
+	 * not bank credit.
+	 */
+	void enqueue(GroupEntity& record)
+	{
+	  Group *group = record.group;
+	  group->threads.enqueue(record);
+
+	  if (!group->in_heap()) {
+	    if ((int64_t) (min_vruntime - group->vruntime) > 0) group->vruntime = min_vruntime;
+	    runnable.insert(*group);
+	  }
+	}
+
+	/**
+	 * Takes a thread off its group's runqueue, taking the group out of the heap if it
+	 * has nothing left to run.
+	 */
+	void dequeue(GroupEntity& record)
+	{
+	  Group *group = record.group;
+	  group->threads.remove(record);
+
+	  if (group->threads.empty() && group->in_heap()) runnable.remove(*group);
+	}
+
+	/**
+	 * Charges a thread's group for the CPU time the thread has used since it was last
+	 * charged, advancing the group's virtual runtime in inverse proportion to its weight.
+	 */
+	void charge(GroupEntity& record)
+	{
+	  uint64_t runtime = runtime_of(*record.entity);
+	  uint64_t used = runtime - record.runtime_mark;
+
+	  record.runtime_mark = runtime;
+	  record.slice_used += used;
+
+	  Group *group = record.group;
+	  group->runtime += used;
+	  group->vruntime += (used * GROUP_DEFAULT_WEIGHT) / group->weight;
+
+	  if (group->in_heap()) runnable.update(*group);
+	}
+
+	// The per-entity records, and the groups.
+	EntityTable<GroupEntity> entities;
+	Group groups[GROUP_MAX_GROUPS];
+	Group overflow;
+
+	// The min-heap of runnable groups, ordered by virtual runtime.
+	IndexedHeap<Group, before, GROUP_MAX_GROUPS + 1> runnable;
+
+	// The entity that was picked last time.
+	GroupEntity *current;
+
+	uint64_t min_vruntime;
+	uint64_t last_stats;
+};
+
+GroupScheduler *GroupScheduler::instance;
+
+bool sched::set_group_weight(Process& process, unsigned int weight)
+{
+  return GroupScheduler::instance->set_group_weight(process, weight);
+}
+
+bool sched::set_entity_group(SchedulingEntity& entity, Process& process)
+{
+  return GroupScheduler::instance->set_entity_group(entity, process);
+}
+
+bool sched::get_group_stats(Process& process, GroupStats& stats)
+{
+  return GroupScheduler::instance->get_group_stats(process, stats);
+}
+
+RegisterScheduler(GroupScheduler);
@@ -0,0 +1,271 @@
+/*
+ * Multi-level Feedback Queue Scheduling Algorithm
+ */
+#include <infos/kernel/sched.h>
+#include <infos/kernel/thread.h>
+#include <infos/kernel/log.h>
+#include <infos/util/lock.h>
+#include <infos/util/cmdline.h>
+
+#include "sched-runqueue.h"
+
+using namespace infos::kernel;
+using namespace infos::util;
+using namespace sched;
+
+// The maximum number of feedback levels that can be configured.
+#define MLFQ_MAX_LEVELS		16
+
+// One millisecond, in nanoseconds.
+#define MLFQ_MS			1000000ULL
+
+// The configuration, which can be changed on the kernel command-line:
+//
+//   sched.mlfq.levels=N		The number of levels (default 4).
+//   sched.mlfq.quanta=A,B,...		The quantum of each level, in milliseconds.  Levels
+//					without an explicit quantum get double the previous
+//					level's (default 10,20,40,...).
+//   sched.mlfq.boost=N		The priority boost interval, in milliseconds (default 1000).
+//					Zero turns boosting off, which lets entities on lower
+//					levels starve.
+static unsigned int mlfq_nr_levels = 4;
+static uint64_t mlfq_quanta[MLFQ_MAX_LEVELS];
+static uint64_t mlfq_boost_interval = 1000 * MLFQ_MS;
+
+RegisterCmdLineArgument(SchedMLFQLevels, "sched.mlfq.levels") {
+  unsigned long n = parse_number(value);
+
+  if (n < 1) n = 1;
+  if (n > MLFQ_MAX_LEVELS) n = MLFQ_MAX_LEVELS;
+
+  mlfq_nr_levels = n;
+}
+
+RegisterCmdLineArgument(SchedMLFQQuanta, "sched.mlfq.quanta") {
+  for (unsigned int i = 0; i < MLFQ_MAX_LEVELS && *value; i++) {
+    mlfq_quanta[i] = parse_number(value) * MLFQ_MS;
+    if (*value == ',') value++;
+  }
+}
+
+RegisterCmdLineArgument(SchedMLFQBoost, "sched.mlfq.boost") {
+  mlfq_boost_interval = parse_number(value) * MLFQ_MS;
+}
+
+/**
+ * A multi-level feedback queue scheduling algorithm.  Entities start on the top level,
+ * which has the shortest quantum.  An entity that uses up its quantum is demoted to the
+ * level below, and an entity that blocks early is promoted to the level above.  Every so
+ * often all entities are boosted back to the top level, so that nothing starves.
+ */
+class MLFQScheduler : public SchedulingAlgorithm
+{
+public:
+	MLFQScheduler() : nonempty(0), current(NULL), boost_epoch(0), last_boost(0), configured(false) { }
+
+	/**
+	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
+	 */
+	const char* name() const override { return "mlfq"; }
+
+	/**
+	 * Called when a scheduling entity becomes eligible for running.
+	 * @param entity
+	 */
+	void add_to_runqueue(SchedulingEntity& entity) override
+	{
+	  UniqueIRQLock l;
+
+	  configure();
+
+	  MLFQEntity *record = entities.get_or_create(entity);
+	  if (!record) {
+	    refuse_entity("mlfq", entity);
+	    return;
+	  }
+
+	  // Entities that slept through a boost are boosted when they wake up.
+	  if (record->epoch != boost_epoch) {
+	    record->level = 0;
+	    record->slice_used = 0;
+	    record->epoch = boost_epoch;
+	  }
+
+	  if (!record->queued()) enqueue(*record);
+	}
+
+	/**
+	 * Called when a scheduling entity is no longer eligible for running.
+	 * @param entity
+	 */
+	void remove_from_runqueue(SchedulingEntity& entity) override
+	{
+	  UniqueIRQLock l;
+
+	  MLFQEntity *record = entities.get(entity);
+	  if (!record) return;
+
+	  if (record->queued()) dequeue(*record);
+
+	  if (record == current) {
+	    charge(*record);
+	    current = NULL;
+
+	    // An entity that gives up the CPU before using half of its quantum is treated
+	    // as interactive, and moves up a level.
+	    if (record->slice_used < mlfq_quanta[record->level] / 2 && record->level > 0) {
+	      record->level--;
+	    }
+
+	    record->slice_used = 0;
+	  }
+
+	  // A stopped entity will never be added back, so give its record up.
+	  if (entity.stopped()) entities.release(record);
+	}
+
+	/**
+	 * Called every time a scheduling event occurs, to cause the next eligible entity
+	 * to be chosen.  The current entity keeps running until its quantum runs out, or
+	 * until an entity on a higher level becomes runnable.
+	 */
+	SchedulingEntity *pick_next_entity() override
+	{
+	  configure();
+
+	  // A zero interval means boosting is off, rather than boosting on every pick.
+	  uint64_t now = sched::now();
+	  if (mlfq_boost_interval && now - last_boost >= mlfq_boost_interval) {
+	    last_boost = now;
+	    boost();
+	  }
+
+	  if (current) {
+	    charge(*current);
+
+	    // Demote the current entity if it has used up its quantum.  Either way, it goes
+	    // to the back of its level once its quantum is over.
+	    if (current->slice_used >= mlfq_quanta[current->level]) {
+	      dequeue(*current);
+
+	      if (current->level < mlfq_nr_levels - 1) current->level++;
+	      current->slice_used = 0;
+
+	      enqueue(*current);
+	      current = NULL;
+	    }
+	  }
+
+	  if (nonempty == 0) {
+	    current = NULL;
+	    return NULL;
+	  }
+
+	  unsigned int top = __builtin_ctz(nonempty);
+
+	  // Keep running the current entity if nothing more urgent is waiting.
+	  if (current && current->level == top) return current->entity;
+
+	  // Otherwise, run the head of the most urgent level.
+	  current = static_cast<MLFQEntity *>(levels[top].first());
+	  current->runtime_mark = runtime_of(*current->entity);
+
+	  return current->entity;
+	}
+
+private:
+	/**
+	 * The per-entity state kept by the MLFQ scheduler.
+	 */
+	struct MLFQEntity : public EntityRecord {
+	  MLFQEntity() : level(0), slice_used(0), runtime_mark(0), epoch(0) { }
+
+	  // The level the entity is on, and how much of that level's quantum it has used.
+	  unsigned int level;
+	  uint64_t slice_used;
+
+	  // The entity's total CPU time when it was last charged.
+	  uint64_t runtime_mark;
+
+	  // The boost epoch the entity's level belongs to.
+	  unsigned long epoch;
+	};
+
+	/**
+	 * Fills in the default quanta for any levels that were not given one on the
+	 * command-line.  This happens on first use, after the command-line is parsed.
+	 */
+	void configure()
+	{
+	  if (configured) return;
+
+	  for (unsigned int i = 0; i < MLFQ_MAX_LEVELS; i++) {
+	    if (mlfq_quanta[i] == 0) mlfq_quanta[i] = i == 0 ? 10 * MLFQ_MS : mlfq_quanta[i - 1] * 2;
+	  }
+
+	  configured = true;
+	}
+
+	/**
+	 * Charges an entity for the CPU time it has used since it was last charged.
+	 */
+	void charge(MLFQEntity& record)
+	{
+	  uint64_t runtime = runtime_of(*record.entity);
+
+	  record.slice_used += runtime - record.runtime_mark;
+	  record.runtime_mark = runtime;
+	}
+
+	/**
+	 * Moves every runnable entity back to the top level.  Entities that are not runnable
+	 * are boosted when they next become runnable.
+	 */
+	void boost()
+	{
+	  boost_epoch++;
+
+	  for (unsigned int level = 1; level < mlfq_nr_levels; level++) {
+	    while (!levels[level].empty()) {
+	      MLFQEntity *record = static_cast<MLFQEntity *>(levels[level].dequeue());
+
+	      record->level = 0;
+	      record->slice_used = 0;
+	      levels[0].enqueue(*record);
+	    }
+	  }
+
+	  // The current entity may still be on the top level, with a partly used quantum.
+	  if (current) current->slice_used = 0;
+
+	  nonempty = levels[0].empty() ? 0 : 1;
+	}
+
+	void enqueue(MLFQEntity& record)
+	{
+	  levels[record.level].enqueue(record);
+	  nonempty |= 1u << record.level;
+	}
+
+	void dequeue(MLFQEntity& record)
+	{
+	  levels[record.level].remove(record);
+	  if (levels[record.level].empty()) nonempty &= ~(1u << record.level);
+	}
+
+	// The per-entity records, which embed the runqueue links.
+	EntityTable<MLFQEntity> entities;
+
+	// One runqueue per level, and a bitmap of the levels that are non-empty.
+	Runqueue levels[MLFQ_MAX_LEVELS];
+	uint32_t nonempty;
+
+	// The entity that was picked last time.
+	MLFQEntity *current;
+
+	unsigned long boost_epoch;
+	uint64_t last_boost;
+	bool configured;
+};
+
+RegisterScheduler(MLFQScheduler);
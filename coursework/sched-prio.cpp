@@ -0,0 +1,195 @@
+/*
+ * Multi-priority Scheduling Algorithm
+ */
+#include <infos/kernel/sched.h>
+#include <infos/kernel/thread.h>
+#include <infos/kernel/log.h>
+#include <infos/util/lock.h>
+
+#include "sched-runqueue.h"
+#include "sched-control.h"
+
+using namespace infos::kernel;
+using namespace infos::util;
+using namespace sched;
+
+// Marks an entity whose priority level has not been chosen yet.
+#define PRIO_UNSET	(~0u)
+
+/**
+ * A fixed-priority scheduling algorithm, with one round-robin runqueue per priority
+ * level.  A bitmap records which levels are non-empty, so that the most urgent
+ * runnable entity is found with a single find-first-set.
+ */
+class PriorityScheduler : public SchedulingAlgorithm
+{
+public:
+	PriorityScheduler() : nonempty(0)
+	{
+	  instance = this;
+	}
+
+	/**
+	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
+	 */
+	const char* name() const override { return "prio"; }
+
+	/**
+	 * Called when a scheduling entity becomes eligible for running.
+	 * @param entity
+	 */
+	void add_to_runqueue(SchedulingEntity& entity) override
+	{
+	  UniqueIRQLock l;
+
+	  PrioEntity *record = entities.get_or_create(entity);
+	  if (!record) {
+	    refuse_entity("prio", entity);
+	    return;
+	  }
+
+	  // Entities that have not been given an explicit priority start at the level that
+	  // corresponds to their kernel priority class.
+	  if (record->level == PRIO_UNSET) record->level = default_level(entity);
+
+	  if (!record->queued()) enqueue(*record);
+	}
+
+	/**
+	 * Called when a scheduling entity is no longer eligible for running.
+	 * @param entity
+	 */
+	void remove_from_runqueue(SchedulingEntity& entity) override
+	{
+	  UniqueIRQLock l;
+
+	  PrioEntity *record = entities.get(entity);
+	  if (!record) return;
+
+	  if (record->queued()) dequeue(*record);
+
+	  // A stopped entity will never be added back, so give its record up.
+	  if (entity.stopped()) entities.release(record);
+	}
+
+	/**
+	 * Called every time a scheduling event occurs, to cause the next eligible entity
+	 * to be chosen.  This is the round-robin successor within the most urgent
+	 * non-empty priority level, and takes constant time.
+	 */
+	SchedulingEntity *pick_next_entity() override
+	{
+	  if (nonempty == 0) return NULL;
+
+	  Runqueue& rq = levels[__builtin_ctzll(nonempty)];
+
+	  // The entity picked goes to the back, even when it is alone, so that anything that
+	  // arrives while it runs is picked before it is picked again.
+	  RunqueueNode *next = rq.rotate();
+	  return static_cast<PrioEntity *>(next)->entity;
+	}
+
+	/**
+	 * Moves an entity to a different priority level.
+	 * @param entity The entity to move.
+	 * @param level The new priority level.
+	 * @return Returns TRUE if the priority was changed.
+	 */
+	bool set_priority(SchedulingEntity& entity, unsigned int level)
+	{
+	  if (level >= SCHED_NR_PRIORITIES) return false;
+
+	  UniqueIRQLock l;
+
+	  // Only an entity the scheduler already tracks is changed: a record made here for
+	  // one it has never seen is only released when the entity stops, which a thread
+	  // that never becomes runnable does not do.
+	  PrioEntity *record = entities.get(entity);
+	  if (!record) return false;
+
+	  if (record->queued()) {
+	    dequeue(*record);
+	    record->level = level;
+	    enqueue(*record);
+	  } else {
+	    record->level = level;
+	  }
+
+	  return true;
+	}
+
+	/**
+	 * Returns the priority level an entity is (or will be) scheduled at.
+	 */
+	unsigned int get_priority(SchedulingEntity& entity)
+	{
+	  UniqueIRQLock l;
+
+	  PrioEntity *record = entities.get(entity);
+	  if (!record || record->level == PRIO_UNSET) return default_level(entity);
+
+	  return record->level;
+	}
+
+	// The registered instance of this algorithm.
+	static PriorityScheduler *instance;
+
+private:
+	/**
+	 * The per-entity state kept by the priority scheduler.
+	 */
+	struct PrioEntity : public EntityRecord {
+	  PrioEntity() : level(PRIO_UNSET) { }
+
+	  unsigned int level;
+	};
+
+	/**
+	 * Returns the initial priority level for an entity, based on its kernel priority
+	 * class.  The classes are spread evenly over the available levels, leaving room
+	 * to adjust entities above and below their class default.
+	 */
+	static unsigned int default_level(const SchedulingEntity& entity)
+	{
+	  switch (entity.priority()) {
+	  case SchedulingEntityPriority::REALTIME:	return 0;
+	  case SchedulingEntityPriority::INTERACTIVE:	return SCHED_NR_PRIORITIES / 4;
+	  case SchedulingEntityPriority::NORMAL:	return SCHED_NR_PRIORITIES / 2;
+	  case SchedulingEntityPriority::DAEMON:	return (SCHED_NR_PRIORITIES * 3) / 4;
+	  default:					return SCHED_NR_PRIORITIES - 1;
+	  }
+	}
+
+	void enqueue(PrioEntity& record)
+	{
+	  levels[record.level].enqueue(record);
+	  nonempty |= 1ULL << record.level;
+	}
+
+	void dequeue(PrioEntity& record)
+	{
+	  levels[record.level].remove(record);
+	  if (levels[record.level].empty()) nonempty &= ~(1ULL << record.level);
+	}
+
+	// The per-entity records, which embed the runqueue links.
+	EntityTable<PrioEntity> entities;
+
+	// One runqueue per priority level, and a bitmap of the levels that are non-empty.
+	Runqueue levels[SCHED_NR_PRIORITIES];
+	uint64_t nonempty;
+};
+
+PriorityScheduler *PriorityScheduler::instance;
+
+bool sched::set_priority(SchedulingEntity& entity, unsigned int level)
+{
+  return PriorityScheduler::instance->set_priority(entity, level);
+}
+
+unsigned int sched::get_priority(SchedulingEntity& entity)
+{
+  return PriorityScheduler::instance->get_priority(entity);
+}
+
+RegisterScheduler(PriorityScheduler);
@@ -9,11 +9,92 @@
 #include <infos/kernel/sched.h>
 #include <infos/kernel/thread.h>
 #include <infos/kernel/log.h>
-#include <infos/util/list.h>
 #include <infos/util/lock.h>
+#include <infos/util/cmdline.h>
+#include <infos/util/string.h>
+#include <infos/drivers/timer/lapic-timer.h>
+
+#include "sched-runqueue.h"
+#include "sched-control.h"
 
 using namespace infos::kernel;
+using namespace infos::drivers::timer;
 using namespace infos::util;
+using namespace sched;
+
+// How often (in nanoseconds) each CPU rebalances its runqueue against the busiest one.
+#define RR_BALANCE_INTERVAL	100000000ULL
+
+// How often (in nanoseconds) the per-CPU scheduler statistics are logged.
+#define RR_STATS_INTERVAL	1000000000ULL
+
+// Marks an entity that is not currently assigned to any CPU's runqueue.
+#define RR_NO_CPU		(~0u)
+
+// One millisecond, and one microsecond, in nanoseconds.
+#define RR_MS			1000000ULL
+#define RR_US			1000ULL
+
+// The longest (in nanoseconds) the scheduler tick is ever stopped for.  Even with
+// nothing to switch between, the kernel still needs the odd tick to keep time.
+#define RR_MAX_DEFERMENT	(1000 * RR_MS)
+
+// How close (in nanoseconds) to its deadline the scheduler tick may already have
+// fired, as the LAPIC timer and the scheduler's clock do not agree exactly.  A tick
+// due within this long is always reprogrammed, rather than trusted to still fire.
+#define RR_TICK_SLACK		(50 * RR_US)
+
+// How heavily each new CPU burst weighs in an entity's moving average burst length,
+// as a power of two: the newest burst counts for 1/2^RR_BURST_SHIFT of the average.
+#define RR_BURST_SHIFT		2
+
+// The configuration, which can be changed on the kernel command-line:
+//
+//   sched.rr.quantum=N		The timeslice, in milliseconds (default 10).
+//   sched.rr.nohz=0|1		Whether the scheduler tick is programmed on demand,
+//					rather than left running periodically (default 0).
+//   sched.rr.adaptive=0|1	Whether each entity's timeslice follows its recent
+//					CPU bursts, rather than being fixed (default 0).
+//   sched.rr.min-slice=N	The shortest adaptive timeslice, in milliseconds
+//					(default 2).
+//   sched.rr.max-slice=N	The longest adaptive timeslice, in milliseconds
+//					(default 50).
+//   sched.rr.cache-hot=N	How long, in microseconds, an entity's cache state is
+//					assumed to survive on the CPU it last ran on once it
+//					stops running (default 500).
+static uint64_t rr_quantum = 10 * RR_MS;
+static bool rr_nohz = false;
+static bool rr_adaptive = false;
+static uint64_t rr_min_slice = 2 * RR_MS;
+static uint64_t rr_max_slice = 50 * RR_MS;
+static uint64_t rr_cache_hot = 500 * RR_US;
+
+RegisterCmdLineArgument(SchedRRQuantum, "sched.rr.quantum") {
+  unsigned long n = parse_number(value);
+  if (n > 0) rr_quantum = n * RR_MS;
+}
+
+RegisterCmdLineArgument(SchedRRNoHZ, "sched.rr.nohz") {
+  rr_nohz = strncmp(value, "0", 1) != 0;
+}
+
+RegisterCmdLineArgument(SchedRRAdaptive, "sched.rr.adaptive") {
+  rr_adaptive = strncmp(value, "0", 1) != 0;
+}
+
+RegisterCmdLineArgument(SchedRRMinSlice, "sched.rr.min-slice") {
+  unsigned long n = parse_number(value);
+  if (n > 0) rr_min_slice = n * RR_MS;
+}
+
+RegisterCmdLineArgument(SchedRRMaxSlice, "sched.rr.max-slice") {
+  unsigned long n = parse_number(value);
+  if (n > 0) rr_max_slice = n * RR_MS;
+}
+
+RegisterCmdLineArgument(SchedRRCacheHot, "sched.rr.cache-hot") {
+  rr_cache_hot = parse_number(value) * RR_US;
+}
 
 /**
  * A round-robin scheduling algorithm
@@ -21,6 +102,15 @@ using namespace infos::util;
 class RoundRobinScheduler : public SchedulingAlgorithm
 {
 public:
+	RoundRobinScheduler() : nr_cpus(0), cpu_tagged(has_cpu_tag()), last_stats(0)
+	{
+	  instance = this;
+
+	  for (unsigned int i = 0; i < ARRAY_SIZE(apic_to_cpu); i++) {
+	    apic_to_cpu[i] = RR_NO_CPU;
+	  }
+	}
+
 	/**
 	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
 	 */
@@ -33,7 +123,30 @@ public:
 	void add_to_runqueue(SchedulingEntity& entity) override
 	{
 	  UniqueIRQLock l;
-	  runqueue.enqueue(&entity);
+
+	  RREntity *record = get_record(entity);
+	  if (!record) return;
+
+	  // An entity placed on another CPU is handed over without touching that CPU's
+	  // lock, and waits for that CPU's next tick.  If that CPU's tick is stopped, it is placed on the
+	  // waking CPU's runqueue, and idle stealing and periodic rebalancing spread entities
+	  // out from there.
+	  unsigned int cpu = this_cpu();
+	  uint64_t now = sched::now();
+
+	  unsigned int target = select_cpu(record, cpu, now);
+	  if (target != cpu && wake_remote(record, target)) return;
+
+	  CPURunqueue& rq = runqueues[cpu];
+
+	  UniqueSpinLock rql(rq.lock);
+	  now = sched::now();
+
+	  enqueue(rq, cpu, record, now);
+
+	  // If the tick was stopped because there was nothing to switch between, there is
+	  // now, so bring the next scheduling event forward.
+	  if (rq.tick_stopped) program_tick(rq, now);
 	}
 
 	/**
@@ -43,7 +156,26 @@ public:
 	void remove_from_runqueue(SchedulingEntity& entity) override
 	{
 	  UniqueIRQLock l;
-	  runqueue.remove(&entity);
+
+	  RREntity *record = entities.get(entity);
+	  if (!record) return;
+
+	  CPURunqueue *rq = lock_runqueue_of(record);
+	  if (rq) {
+	    uint64_t now = sched::now();
+
+	    // The entity may still be waiting on the runqueue's pending list.
+	    drain_pending(*rq);
+	    detach(*rq, record, now);
+
+	    rq->lock.unlock();
+	  }
+
+	  // A stopped entity will never be added back, so give its record up.
+	  if (entity.stopped()) {
+	    UniqueSpinLock tl(entities_lock);
+	    entities.release(record);
+	  }
 	}
 
 	/**
@@ -53,15 +185,674 @@ public:
 	 */
 	SchedulingEntity *pick_next_entity() override
 	{
-	  if (runqueue.count() == 0) return NULL;
-	  if (runqueue.count() >= 1) return runqueue.first();
+	  unsigned int cpu = this_cpu();
+	  CPURunqueue& rq = runqueues[cpu];
+	  uint64_t now = sched::now();
+
+	  // Take in any entities that other CPUs have woken onto this one.
+	  if (__atomic_load_n(&rq.pending, __ATOMIC_RELAXED)) {
+	    UniqueSpinLock rql(rq.lock);
+	    drain_pending(rq);
+	  }
+
+	  // An idle CPU steals work straight away; a busy one only rebalances periodically.
+	  if (rq.queue.empty()) {
+	    if (steal(cpu, true)) rq.nr_steals++;
+	  } else if (now - rq.last_balance >= RR_BALANCE_INTERVAL) {
+	    rq.last_balance = now;
+	    if (steal(cpu, false)) rq.nr_balances++;
+	  }
+
+	  if (cpu == 0 && now - last_stats >= RR_STATS_INTERVAL) {
+	    last_stats = now;
+	    dump_state();
+	  }
+
+	  UniqueSpinLock rql(rq.lock);
+
+	  // Keep running the current entity until its quantum is over.  Then move the head
+	  // of the runqueue to the back, and run it.  The entity picked always goes to the
+	  // back, even when it is alone, so that anything that arrives while it runs is
+	  // ahead of it when its quantum is over.
+	  RREntity *prev = rq.current;
+	  RREntity *next;
+
+	  if (prev && (rq.queue.count() == 1 || now - prev->run_start < timeslice(prev))) {
+	    next = prev;
+	  } else {
+	    next = static_cast<RREntity *>(rq.queue.rotate());
+	  }
+
+	  if (next != prev) account_switch(rq, prev, next, now);
+	  rq.current = next;
+
+	  program_tick(rq, now);
+
+	  return next ? next->entity : NULL;
+	}
+
+	/**
+	 * Retrieves the accounting kept for an entity.
+	 */
+	bool get_entity_stats(SchedulingEntity& entity, EntitySchedStats& stats)
+	{
+	  UniqueIRQLock l;
+
+	  RREntity *record = entities.get(entity);
+	  if (!record) return false;
+
+	  CPURunqueue *rq = lock_runqueue_of(record);
+
+	  stats.wait_time = record->wait_time;
+	  stats.run_time = record->run_time;
+	  stats.nr_voluntary = record->nr_voluntary;
+	  stats.nr_involuntary = record->nr_involuntary;
+	  stats.timeslice = timeslice(record);
+	  stats.nr_migrations = record->nr_migrations;
+
+	  if (rq) rq->lock.unlock();
+	  return true;
+	}
+
+	/**
+	 * Sums the per-CPU wake-to-run latency histograms.
+	 */
+	void get_wakeup_latency(unsigned long *buckets)
+	{
+	  unsigned int nr_online = online_cpus();
+
+	  for (unsigned int b = 0; b < SCHED_LATENCY_BUCKETS; b++) {
+	    buckets[b] = 0;
+	    for (unsigned int i = 0; i < nr_online; i++) {
+	      buckets[b] += __atomic_load_n(&runqueues[i].wakeup_latency[b], __ATOMIC_RELAXED);
+	    }
+	  }
+	}
+
+	/**
+	 * Logs the per-CPU runqueue statistics.
+	 */
+	void dump_state()
+	{
+	  unsigned int nr_online = online_cpus();
+
+	  for (unsigned int i = 0; i < nr_online; i++) {
+	    const CPURunqueue& rq = runqueues[i];
+
+	    sched_log.messagef(LogLevel::DEBUG, "rr: cpu%u: runnable=%u migrations=%lu steals=%lu balances=%lu remote-wakeups=%lu",
+	      i, rq.queue.count(), rq.nr_migrations, rq.nr_steals, rq.nr_balances, rq.nr_remote_wakeups);
+	  }
+
+	  unsigned long buckets[SCHED_LATENCY_BUCKETS];
+	  get_wakeup_latency(buckets);
+
+	  for (unsigned int b = 0; b < SCHED_LATENCY_BUCKETS; b++) {
+	    if (buckets[b]) sched_log.messagef(LogLevel::DEBUG, "rr: wake-to-run < %luus: %lu", 1UL << b, buckets[b]);
+	  }
 	}
 
+	// The registered instance of this algorithm.
+	static RoundRobinScheduler *instance;
+
 private:
-	// A list containing the current runqueue.
-	List<SchedulingEntity *> runqueue;
+	/**
+	 * The per-entity state kept by the round-robin scheduler.
+	 */
+	struct RREntity : public EntityRecord {
+	  RREntity()
+	    : cpu(RR_NO_CPU), woken(false), pending(false), migrated(false), pending_next(NULL), wait_start(0),
+	      run_start(0), last_ran(0), wait_time(0), run_time(0), nr_voluntary(0), nr_involuntary(0),
+	      nr_migrations(0), burst_avg(0) { }
+
+	  /**
+	   * Called when the entity stops running, to fold the CPU burst that has just ended
+	   * into the moving average.
+	   */
+	  void end_burst(uint64_t now)
+	  {
+	    uint64_t burst = now - run_start;
+	    last_ran = now;
+
+	    if (!burst_avg) {
+	      burst_avg = burst;
+	    } else if (burst > burst_avg) {
+	      burst_avg += (burst - burst_avg) >> RR_BURST_SHIFT;
+	    } else {
+	      burst_avg -= (burst_avg - burst) >> RR_BURST_SHIFT;
+	    }
+	  }
+
+	  // The CPU whose runqueue this entity is (or was last) queued on.
+	  unsigned int cpu;
+
+	  // TRUE if the entity has not run since it last became runnable.
+	  bool woken;
+
+	  // TRUE while the entity is on its CPU's pending list, and the next entity on it.
+	  // The entity is marked as migrated if it was pushed onto a different CPU's list
+	  // than the one it last ran on.
+	  bool pending, migrated;
+	  RREntity *pending_next;
+
+	  // When the entity's current wait, or current run, started, and when it last
+	  // stopped running.
+	  uint64_t wait_start, run_start, last_ran;
+
+	  // The accounting.
+	  uint64_t wait_time, run_time;
+	  unsigned long nr_voluntary, nr_involuntary;
+
+	  // The number of times the entity has moved to a different CPU.
+	  unsigned long nr_migrations;
+
+	  // The moving average length of the entity's CPU bursts, i.e. how long it runs
+	  // before blocking or being preempted, or zero until the first one ends.
+	  uint64_t burst_avg;
+	};
+
+	/**
+	 * The per-CPU runqueue, and its statistics.
+	 */
+	struct CPURunqueue {
+	  CPURunqueue()
+	    : current(NULL), pending(NULL), last_balance(0), nr_migrations(0), nr_steals(0), nr_balances(0),
+	      nr_remote_wakeups(0), timer(NULL), timer_probed(false), tick_stopped(false), tick_deadline(0)
+	  {
+	    for (unsigned int i = 0; i < SCHED_LATENCY_BUCKETS; i++) wakeup_latency[i] = 0;
+	  }
+
+	  SpinLock lock;
+	  Runqueue queue;
+
+	  // The entity this CPU is currently running, which may not be migrated away.
+	  RREntity *current;
+
+	  // Entities woken onto this CPU by other CPUs, which push onto it without taking
+	  // the lock.  It is drained, most recent first, by whoever holds the lock.
+	  RREntity *pending;
+
+	  uint64_t last_balance;
+
+	  // Entities that arrived on this runqueue from a different CPU.
+	  unsigned long nr_migrations;
+
+	  // Idle steals, and periodic rebalances, that actually moved work to this CPU.
+	  unsigned long nr_steals, nr_balances;
+
+	  // Entities woken onto this CPU's pending list by other CPUs.
+	  unsigned long nr_remote_wakeups;
+
+	  // The wake-to-run latency histogram for entities that ran on this CPU.  Bucket i
+	  // counts latencies below 2^i microseconds.
+	  unsigned long wakeup_latency[SCHED_LATENCY_BUCKETS];
+
+	  // The timer that delivers this CPU's scheduling events, and whether the periodic
+	  // part of the tick is currently stopped.
+	  Timer *timer;
+	  bool timer_probed, tick_stopped;
+
+	  // When the timer is currently programmed to fire.
+	  uint64_t tick_deadline;
+	};
+
+	/**
+	 * Takes an entity off a CPU's runqueue, whose lock must be held.  An entity that
+	 * leaves the runqueue while it is running has given up the CPU voluntarily (e.g. by
+	 * blocking).  Otherwise, it was still waiting.
+	 */
+	static void detach(CPURunqueue& rq, RREntity *record, uint64_t now)
+	{
+	  if (rq.current == record) {
+	    rq.current = NULL;
+
+	    record->run_time += now - record->run_start;
+	    record->nr_voluntary++;
+	    record->end_burst(now);
+	  } else if (record->queued()) {
+	    record->wait_time += now - record->wait_start;
+	  }
+
+	  // The record knows its own neighbours, so unlinking is O(1).
+	  if (record->queued()) rq.queue.remove(*record);
+	}
+
+	/**
+	 * Places an entity at the tail of a CPU's runqueue, whose lock must be held.
+	 */
+	static void enqueue(CPURunqueue& rq, unsigned int cpu, RREntity *record, uint64_t now)
+	{
+	  if (record->queued()) return;
+
+	  if (record->cpu != RR_NO_CPU && record->cpu != cpu) {
+	    rq.nr_migrations++;
+	    record->nr_migrations++;
+	  }
+
+	  rq.queue.enqueue(*record);
+	  record->cpu = cpu;
+
+	  // Start the clock on the entity's wait, and on its wake-to-run latency.
+	  record->wait_start = now;
+	  record->woken = true;
+	}
+
+	/**
+	 * Chooses the CPU that a waking entity should be placed on.  While the entity's
+	 * cache state is still warm, that is the CPU it last ran on; otherwise, it is the
+	 * least loaded CPU, preferring the waking CPU when there is a tie.
+	 */
+	unsigned int select_cpu(RREntity *record, unsigned int cpu, uint64_t now)
+	{
+	  unsigned int nr_online = online_cpus();
+	  unsigned int last = __atomic_load_n(&record->cpu, __ATOMIC_ACQUIRE);
+
+	  if (last != RR_NO_CPU && last < nr_online && record->last_ran && now - record->last_ran < rr_cache_hot) {
+	    return last;
+	  }
+
+	  // The loads are read without the locks, so this is only a hint.
+	  unsigned int best = cpu, best_load = runqueues[cpu].queue.count();
+	  for (unsigned int i = 0; i < nr_online && best_load > 0; i++) {
+	    unsigned int load = runqueues[i].queue.count();
+
+	    if (load < best_load) {
+	      best = i;
+	      best_load = load;
+	    }
+	  }
+
+	  return best;
+	}
+
+	/**
+	 * Wakes an entity onto another CPU by pushing it onto that CPU's pending list.
+	 * InfOS has no IPI for the scheduler to interrupt the other CPU with, so the entity
+	 * only becomes eligible to run at that CPU's next scheduling event.  This is
+	 * therefore refused if the CPU's tick is stopped, and the entity is woken onto the
+	 * waking CPU instead.
+	 * @return Returns TRUE if the entity was woken remotely, or was already runnable.
+	 */
+	bool wake_remote(RREntity *record, unsigned int target)
+	{
+	  CPURunqueue& rq = runqueues[target];
+	  if (__atomic_load_n(&rq.tick_stopped, __ATOMIC_RELAXED)) return false;
+
+	  // As on the local path, an entity that is already queued stays where it is.  Its
+	  // runqueue's lock is held until it is on the pending list, so that it cannot be
+	  // queued or migrated in between.
+	  CPURunqueue *from = lock_runqueue_of(record);
+	  if (from && record->queued()) {
+	    from->lock.unlock();
+	    return true;
+	  }
+
+	  // The entity is already on its way.
+	  if (__atomic_exchange_n(&record->pending, true, __ATOMIC_ACQ_REL)) {
+	    if (from) from->lock.unlock();
+	    return true;
+	  }
+
+	  record->wait_start = sched::now();
+	  record->woken = true;
+
+	  // The record must point at its new runqueue before it becomes visible there, so
+	  // that lock_runqueue_of() finds it.
+	  unsigned int last = record->cpu;
+	  record->migrated = last != RR_NO_CPU && last != target;
+	  __atomic_store_n(&record->cpu, target, __ATOMIC_RELEASE);
+
+	  RREntity *head = __atomic_load_n(&rq.pending, __ATOMIC_RELAXED);
+	  do {
+	    record->pending_next = head;
+	  } while (!__atomic_compare_exchange_n(&rq.pending, &head, record, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	  if (from) from->lock.unlock();
+
+	  __atomic_fetch_add(&rq.nr_remote_wakeups, 1, __ATOMIC_RELAXED);
+	  return true;
+	}
+
+	/**
+	 * Moves the entities on a runqueue's pending list onto the runqueue itself, in the
+	 * order in which they were woken.  The runqueue's lock must be held.
+	 */
+	static void drain_pending(CPURunqueue& rq)
+	{
+	  RREntity *list = __atomic_exchange_n(&rq.pending, (RREntity *) NULL, __ATOMIC_ACQUIRE);
+
+	  RREntity *ordered = NULL;
+	  while (list) {
+	    RREntity *next = list->pending_next;
+	    list->pending_next = ordered;
+	    ordered = list;
+	    list = next;
+	  }
+
+	  while (ordered) {
+	    RREntity *next = ordered->pending_next;
+
+	    ordered->pending_next = NULL;
+	    rq.queue.enqueue(*ordered);
+
+	    if (ordered->migrated) {
+	      ordered->migrated = false;
+	      ordered->nr_migrations++;
+	      rq.nr_migrations++;
+	    }
+
+	    __atomic_store_n(&ordered->pending, false, __ATOMIC_RELEASE);
+
+	    ordered = next;
+	  }
+	}
+
+	/**
+	 * Programs the next scheduling event for a CPU from what its runqueue actually
+	 * needs.  With nothing to run, or only one entity to run, there is nothing to switch
+	 * between, so the tick is stopped.  Otherwise, the event fires when the current
+	 * entity's quantum runs out.  The timer is only reprogrammed when that moves the
+	 * next event, as doing so stops and restarts the LAPIC timer.  The runqueue lock
+	 * must be held.
+	 */
+	void program_tick(CPURunqueue& rq, uint64_t now)
+	{
+	  if (!rr_nohz) return;
+
+	  // Only the boot CPU's LAPIC timer is registered with the device manager.
+	  if (!rq.timer_probed) {
+	    rq.timer_probed = true;
+	    if (&rq == &runqueues[0]) sys.device_manager().try_get_device_by_class(LAPICTimer::LAPICTimerDeviceClass, rq.timer);
+	  }
+
+	  if (!rq.timer) return;
+
+	  bool armed = rq.tick_deadline > now + RR_TICK_SLACK;
+
+	  uint64_t deadline;
+	  if (!rq.current && !rq.queue.empty()) {
+	    // The CPU is idle but has work queued (e.g. something has just woken up), so
+	    // take a scheduling event straight away.
+	    deadline = now;
+	    rq.tick_stopped = false;
+	  } else if (rq.queue.count() <= 1) {
+	    // A tick that is already stopped stays stopped until its deferment runs out.
+	    deadline = rq.tick_stopped && armed ? rq.tick_deadline : now + RR_MAX_DEFERMENT;
+	    rq.tick_stopped = true;
+	  } else {
+	    uint64_t used = rq.current ? now - rq.current->run_start : 0;
+	    uint64_t slice = rq.current ? timeslice(rq.current) : rr_quantum;
+	    deadline = used < slice ? now + (slice - used) : now;
+	    rq.tick_stopped = false;
+	  }
+
+	  if (armed && deadline == rq.tick_deadline) return;
+	  rq.tick_deadline = deadline;
+
+	  // Round up, so that the tick never fires before the deadline.
+	  uint64_t ticks = ((deadline - now) * rq.timer->frequency() + 999999999ULL) / 1000000000ULL;
+
+	  rq.timer->stop();
+	  rq.timer->init_oneshot(ticks ? ticks : 1);
+	  rq.timer->start();
+	}
+
+	/**
+	 * Returns the timeslice an entity gets each time it is picked.  In adaptive mode,
+	 * this is twice its average burst, so an entity that usually blocks early gets a
+	 * short slice, and one that always runs it out gets a longer one each time, within
+	 * the configured bounds.
+	 */
+	static uint64_t timeslice(const RREntity *record)
+	{
+	  if (!rr_adaptive) return rr_quantum;
+
+	  uint64_t min = rr_min_slice;
+	  uint64_t max = rr_max_slice > min ? rr_max_slice : min;
+	  uint64_t slice = record->burst_avg ? record->burst_avg * 2 : rr_quantum;
+
+	  if (slice < min) return min;
+	  if (slice > max) return max;
+	  return slice;
+	}
+
+	/**
+	 * Updates the accounting when a CPU switches from one entity to another.  Only the
+	 * switching CPU's state is touched, and its runqueue lock is already held.
+	 */
+	static void account_switch(CPURunqueue& rq, RREntity *prev, RREntity *next, uint64_t now)
+	{
+	  // The previous entity is still runnable, so it was preempted and is waiting again.
+	  if (prev) {
+	    prev->run_time += now - prev->run_start;
+	    prev->nr_involuntary++;
+	    prev->end_burst(now);
+	    prev->wait_start = now;
+	  }
+
+	  if (next) {
+	    uint64_t waited = now - next->wait_start;
+
+	    next->wait_time += waited;
+	    next->run_start = now;
+
+	    if (next->woken) {
+	      next->woken = false;
+	      rq.wakeup_latency[latency_bucket(waited)]++;
+	    }
+	  }
+	}
+
+	/**
+	 * Returns the histogram bucket for a latency, in nanoseconds.
+	 */
+	static unsigned int latency_bucket(uint64_t latency)
+	{
+	  uint64_t us = latency / 1000;
+	  unsigned int bucket = us ? 64 - __builtin_clzll(us) : 0;
+
+	  return bucket < SCHED_LATENCY_BUCKETS ? bucket : SCHED_LATENCY_BUCKETS - 1;
+	}
+
+	/**
+	 * Returns the index of the runqueue that belongs to the executing CPU.  CPUs are
+	 * numbered in the order in which they first enter the scheduler, which is when
+	 * their APIC IDs are looked up.  From then on, the index is read back from the
+	 * CPU's tag, where the processor has one.  Every CPU must have a runqueue of its
+	 * own, so the system is halted when a CPU enters the scheduler and all
+	 * SCHED_MAX_CPUS runqueues are already taken.
+	 */
+	unsigned int this_cpu()
+	{
+	  // The tag holds the index plus one, as it starts off as zero.
+	  if (cpu_tagged) {
+	    unsigned int tag = current_cpu_tag();
+	    if (tag) return tag - 1;
+	  }
+
+	  unsigned int apic_id = current_apic_id() % ARRAY_SIZE(apic_to_cpu);
+
+	  unsigned int cpu = __atomic_load_n(&apic_to_cpu[apic_id], __ATOMIC_ACQUIRE);
+	  if (cpu != RR_NO_CPU) return cpu;
+
+	  // Only this CPU ever writes its own entry, so there is no race on it.
+	  cpu = __atomic_fetch_add(&nr_cpus, 1, __ATOMIC_ACQ_REL);
+
+	  // Two CPUs sharing a runqueue could both pick the same entity, so there is no
+	  // safe way to carry on with more CPUs than runqueues.
+	  if (cpu >= SCHED_MAX_CPUS) {
+	    sched_log.messagef(LogLevel::FATAL, "rr: cpu with apic-id=%u is cpu %u, but at most %u are supported (raise SCHED_MAX_CPUS)",
+	      apic_id, cpu + 1, SCHED_MAX_CPUS);
+	    assert(cpu < SCHED_MAX_CPUS);
+	  }
+
+	  __atomic_store_n(&apic_to_cpu[apic_id], cpu, __ATOMIC_RELEASE);
+	  if (cpu_tagged) set_cpu_tag(cpu + 1);
+
+	  return cpu;
+	}
+
+	/**
+	 * Returns the number of CPUs that have runqueues in use.
+	 */
+	unsigned int online_cpus() const
+	{
+	  unsigned int n = __atomic_load_n(&nr_cpus, __ATOMIC_ACQUIRE);
+	  return n > SCHED_MAX_CPUS ? SCHED_MAX_CPUS : n;
+	}
+
+	/**
+	 * Finds the record for an entity, creating it on first sight.
+	 * @return Returns the record, or NULL if the entity table could not grow to make
+	 * room for it, in which case the entity has been refused.
+	 */
+	RREntity *get_record(SchedulingEntity& entity)
+	{
+	  RREntity *record = entities.get(entity);
+	  if (record) return record;
+
+	  UniqueSpinLock tl(entities_lock);
+
+	  record = entities.get_or_create(entity);
+	  if (!record) refuse_entity("rr", entity);
+
+	  return record;
+	}
+
+	/**
+	 * Locks the runqueue that a record is assigned to.  The record may be migrated
+	 * concurrently, so the assignment is re-checked once the lock is held.
+	 * @return Returns the locked runqueue, or NULL if the record is not assigned to one.
+	 */
+	CPURunqueue *lock_runqueue_of(RREntity *record)
+	{
+	  for (;;) {
+	    unsigned int cpu = __atomic_load_n(&record->cpu, __ATOMIC_ACQUIRE);
+	    if (cpu == RR_NO_CPU) return NULL;
+
+	    CPURunqueue& rq = runqueues[cpu];
+	    rq.lock.lock();
+
+	    if (record->cpu == cpu) return &rq;
+	    rq.lock.unlock();
+	  }
+	}
+
+	/**
+	 * Locks the runqueues of two CPUs (which may be the same CPU).  The locks are always
+	 * taken in CPU order, so that two CPUs locking each other's runqueues cannot
+	 * deadlock.
+	 */
+	void lock_pair(unsigned int a, unsigned int b)
+	{
+	  if (a == b) {
+	    runqueues[a].lock.lock();
+	  } else if (a < b) {
+	    runqueues[a].lock.lock();
+	    runqueues[b].lock.lock();
+	  } else {
+	    runqueues[b].lock.lock();
+	    runqueues[a].lock.lock();
+	  }
+	}
+
+	void unlock_pair(unsigned int a, unsigned int b)
+	{
+	  runqueues[a].lock.unlock();
+	  if (a != b) runqueues[b].lock.unlock();
+	}
+
+	/**
+	 * Pulls work from the busiest runqueue onto this CPU's runqueue.  An idle CPU takes
+	 * half of the busiest runqueue, otherwise only enough to even the two out.
+	 * @param cpu The CPU doing the pulling.
+	 * @param idle TRUE if the CPU has nothing to run.
+	 * @return Returns TRUE if any entities were moved.
+	 */
+	bool steal(unsigned int cpu, bool idle)
+	{
+	  unsigned int nr_online = online_cpus();
+	  if (nr_online < 2) return false;
+
+	  // Find the busiest runqueue, without taking any locks.
+	  unsigned int busiest = cpu, busiest_count = 0;
+	  for (unsigned int i = 0; i < nr_online; i++) {
+	    unsigned int count = runqueues[i].queue.count();
+
+	    if (i != cpu && count > busiest_count) {
+	      busiest = i;
+	      busiest_count = count;
+	    }
+	  }
+
+	  if (busiest == cpu) return false;
+
+	  CPURunqueue& to = runqueues[cpu];
+	  CPURunqueue& from = runqueues[busiest];
+
+	  lock_pair(cpu, busiest);
+	  drain_pending(from);
+
+	  unsigned int nr_to_move = 0;
+	  if (idle) {
+	    nr_to_move = (from.queue.count() + 1) / 2;
+	  } else if (from.queue.count() > to.queue.count() + 1) {
+	    nr_to_move = (from.queue.count() - to.queue.count()) / 2;
+	  }
+
+	  // Take entities from the tail, which is furthest from running on the victim,
+	  // skipping the entity the victim is running right now.
+	  unsigned int nr_moved = 0;
+	  RunqueueNode *node = from.queue.last();
+	  while (node && nr_moved < nr_to_move) {
+	    RunqueueNode *prev = Runqueue::prev(*node);
+	    RREntity *record = static_cast<RREntity *>(node);
+
+	    if (record != from.current) {
+	      from.queue.remove(*record);
+	      to.queue.enqueue(*record);
+	      __atomic_store_n(&record->cpu, cpu, __ATOMIC_RELEASE);
+
+	      to.nr_migrations++;
+	      record->nr_migrations++;
+	      nr_moved++;
+	    }
+
+	    node = prev;
+	  }
+
+	  unlock_pair(cpu, busiest);
+
+	  return nr_moved > 0;
+	}
+
+	// The per-entity records, which embed the runqueue links.  Lookups are lock-free;
+	// creating or releasing a record takes the table lock.
+	EntityTable<RREntity> entities;
+	SpinLock entities_lock;
+
+	// The per-CPU runqueues, and the mapping from APIC IDs to runqueue indices.
+	CPURunqueue runqueues[SCHED_MAX_CPUS];
+	unsigned int apic_to_cpu[256];
+	unsigned int nr_cpus;
+
+	// Whether CPUs cache their runqueue index in their tag.
+	bool cpu_tagged;
+
+	uint64_t last_stats;
 };
 
+RoundRobinScheduler *RoundRobinScheduler::instance;
+
+bool sched::get_entity_stats(SchedulingEntity& entity, EntitySchedStats& stats)
+{
+  return RoundRobinScheduler::instance->get_entity_stats(entity, stats);
+}
+
+void sched::get_wakeup_latency(unsigned long *buckets)
+{
+  RoundRobinScheduler::instance->get_wakeup_latency(buckets);
+}
+
 /* --- DO NOT CHANGE ANYTHING BELOW THIS LINE --- */
 
 RegisterScheduler(RoundRobinScheduler);
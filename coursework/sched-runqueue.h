@@ -0,0 +1,848 @@
+/*
+ * Intrusive Runqueue Support for Scheduling Algorithms
+ */
+#ifndef SCHED_RUNQUEUE_H
+#define SCHED_RUNQUEUE_H
+
+#include <infos/kernel/sched-entity.h>
+#include <infos/kernel/sched.h>
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/log.h>
+#include <infos/assert.h>
+
+// The number of scheduling entities a scheduling algorithm can keep per-entity state
+// for before its tables have to grow.
+#define SCHED_MAX_ENTITIES	1024
+
+// The maximum number of CPUs a scheduling algorithm keeps per-CPU state for.
+#define SCHED_MAX_CPUS		8
+
+namespace sched {
+
+	/**
+	 * Returns the current system runtime, in nanoseconds.
+	 */
+	static inline uint64_t now()
+	{
+		return infos::kernel::sys.runtime().count();
+	}
+
+	/**
+	 * Returns the total CPU time an entity has consumed so far, in nanoseconds.
+	 */
+	static inline uint64_t runtime_of(const infos::kernel::SchedulingEntity& entity)
+	{
+		return entity.cpu_runtime().count();
+	}
+
+	/**
+	 * Parses a decimal number from a command-line argument value, advancing the value
+	 * pointer past the digits that were consumed.
+	 */
+	static inline unsigned long parse_number(const char *& value)
+	{
+		unsigned long n = 0;
+
+		while (*value >= '0' && *value <= '9') {
+			n = (n * 10) + (*value++ - '0');
+		}
+
+		return n;
+	}
+
+	/**
+	 * Refuses to schedule an entity that a scheduling algorithm has no memory to keep
+	 * track of, which every algorithm does in the same way.  The kernel still believes
+	 * the entity is runnable, but the algorithm never picks it: it only gets another
+	 * chance when the kernel next adds it to the runqueue.  A thread refused as it
+	 * becomes runnable therefore hangs until it is woken again (if ever), so the error
+	 * is logged to make such a hang traceable.
+	 * @param alg The name of the refusing algorithm.
+	 * @param entity The entity that will not be scheduled.
+	 */
+	static inline void refuse_entity(const char *alg, const infos::kernel::SchedulingEntity& entity)
+	{
+		infos::kernel::sched_log.messagef(infos::kernel::LogLevel::ERROR,
+			"%s: out of memory for entity=%p, it will not run until it is added again", alg, &entity);
+	}
+
+#ifdef SCHED_SIM
+	// The host-side simulator decides for itself which simulated CPU is executing, so
+	// it provides the CPU identification primitives below.
+	unsigned int current_apic_id();
+	bool has_cpu_tag();
+	unsigned int current_cpu_tag();
+	void set_cpu_tag(unsigned int tag);
+#else
+	/**
+	 * Returns the initial APIC ID of the CPU that is executing this code.  CPUID is
+	 * serialising, and traps to the hypervisor under KVM, so this is slow: callers
+	 * that need it often should cache what they derive from it with set_cpu_tag().
+	 */
+	static inline unsigned int current_apic_id()
+	{
+		uint32_t eax = 1, ebx, ecx = 0, edx;
+		asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+
+		return ebx >> 24;
+	}
+
+	/**
+	 * Returns TRUE if the processor supports RDTSCP, and so has a per-CPU tag
+	 * (the IA32_TSC_AUX MSR) that can be read back cheaply.
+	 */
+	static inline bool has_cpu_tag()
+	{
+		uint32_t eax = 0x80000001, ebx, ecx = 0, edx;
+		asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+
+		return edx & (1u << 27);
+	}
+
+	/**
+	 * Returns the executing CPU's tag, which is zero until set_cpu_tag() is called on
+	 * it.  RDTSCP is neither serialising nor intercepted, unlike CPUID.
+	 */
+	static inline unsigned int current_cpu_tag()
+	{
+		uint32_t lo, hi, aux;
+		asm volatile("rdtscp" : "=a"(lo), "=d"(hi), "=c"(aux));
+
+		return aux;
+	}
+
+	/**
+	 * Sets the executing CPU's tag.
+	 */
+	static inline void set_cpu_tag(unsigned int tag)
+	{
+		asm volatile("wrmsr" : : "c"(0xc0000103), "a"(tag), "d"(0));
+	}
+#endif
+
+	/**
+	 * A simple test-and-set spinlock, for protecting per-CPU scheduler state.  This
+	 * does NOT disable interrupts -- callers that can race with the timer interrupt
+	 * must also hold an IRQ lock.
+	 */
+	class SpinLock {
+	public:
+		SpinLock() : _locked(0) { }
+
+		void lock()
+		{
+			while (__atomic_exchange_n(&_locked, 1, __ATOMIC_ACQUIRE)) {
+				while (__atomic_load_n(&_locked, __ATOMIC_RELAXED)) {
+					asm volatile("pause");
+				}
+			}
+		}
+
+		bool try_lock()
+		{
+			return !__atomic_exchange_n(&_locked, 1, __ATOMIC_ACQUIRE);
+		}
+
+		void unlock()
+		{
+			__atomic_store_n(&_locked, 0, __ATOMIC_RELEASE);
+		}
+
+	private:
+		uint8_t _locked;
+	};
+
+	/**
+	 * Holds a SpinLock for the lifetime of the object.
+	 */
+	class UniqueSpinLock {
+	public:
+		UniqueSpinLock(SpinLock& lock) : _lock(lock) { _lock.lock(); }
+		~UniqueSpinLock() { _lock.unlock(); }
+
+	private:
+		SpinLock& _lock;
+	};
+
+	/**
+	 * The link fields that allow an object to sit on a Runqueue.  Anything that
+	 * needs to be queued embeds (i.e. derives from) this node, so that linking and
+	 * unlinking never allocates memory.
+	 */
+	class RunqueueNode {
+		friend class Runqueue;
+
+	public:
+		RunqueueNode() : _prev(NULL), _next(NULL), _queued(false) { }
+
+		/**
+		 * Returns TRUE if this node is currently linked into a runqueue.
+		 */
+		bool queued() const { return _queued; }
+
+	private:
+		RunqueueNode *_prev, *_next;
+		bool _queued;
+	};
+
+	/**
+	 * A doubly-linked, intrusive FIFO of RunqueueNodes.  All operations are O(1),
+	 * and none of them allocate.
+	 */
+	class Runqueue {
+	public:
+		Runqueue() : _head(NULL), _tail(NULL), _count(0) { }
+
+		/**
+		 * Appends a node to the tail of the runqueue.
+		 * @param node The node to append.  It must not already be queued.
+		 */
+		void enqueue(RunqueueNode& node)
+		{
+			assert(!node._queued);
+
+			node._prev = _tail;
+			node._next = NULL;
+
+			if (_tail) {
+				_tail->_next = &node;
+			} else {
+				_head = &node;
+			}
+
+			_tail = &node;
+			node._queued = true;
+			_count++;
+		}
+
+		/**
+		 * Inserts a node at the head of the runqueue.
+		 * @param node The node to insert.  It must not already be queued.
+		 */
+		void push(RunqueueNode& node)
+		{
+			assert(!node._queued);
+
+			node._prev = NULL;
+			node._next = _head;
+
+			if (_head) {
+				_head->_prev = &node;
+			} else {
+				_tail = &node;
+			}
+
+			_head = &node;
+			node._queued = true;
+			_count++;
+		}
+
+		/**
+		 * Unlinks a node from the runqueue.
+		 * @param node The node to remove.  It must be queued on THIS runqueue.
+		 */
+		void remove(RunqueueNode& node)
+		{
+			assert(node._queued);
+
+			if (node._prev) {
+				node._prev->_next = node._next;
+			} else {
+				_head = node._next;
+			}
+
+			if (node._next) {
+				node._next->_prev = node._prev;
+			} else {
+				_tail = node._prev;
+			}
+
+			node._prev = NULL;
+			node._next = NULL;
+			node._queued = false;
+			_count--;
+		}
+
+		/**
+		 * Removes and returns the node at the head of the runqueue.
+		 * @return Returns the head node, or NULL if the runqueue is empty.
+		 */
+		RunqueueNode *dequeue()
+		{
+			RunqueueNode *node = _head;
+			if (node) remove(*node);
+
+			return node;
+		}
+
+		/**
+		 * Moves the head of the runqueue to the tail.
+		 * @return Returns the node that was moved, or NULL if the runqueue is empty.
+		 */
+		RunqueueNode *rotate()
+		{
+			RunqueueNode *node = dequeue();
+			if (node) enqueue(*node);
+
+			return node;
+		}
+
+		RunqueueNode *first() const { return _head; }
+		RunqueueNode *last() const { return _tail; }
+		static RunqueueNode *next(const RunqueueNode& node) { return node._next; }
+		static RunqueueNode *prev(const RunqueueNode& node) { return node._prev; }
+
+		unsigned int count() const { return _count; }
+		bool empty() const { return _count == 0; }
+
+	private:
+		RunqueueNode *_head, *_tail;
+		unsigned int _count;
+	};
+
+	/**
+	 * The link field that allows an object to sit in an IndexedHeap.
+	 */
+	struct HeapNode {
+		static const unsigned int NOT_IN_HEAP = ~0u;
+
+		HeapNode() : heap_index(NOT_IN_HEAP) { }
+
+		bool in_heap() const { return heap_index != NOT_IN_HEAP; }
+
+		// The node's position in the heap.
+		unsigned int heap_index;
+	};
+
+	/**
+	 * A binary min-heap of HeapNodes.  Each node records its own position, so insert,
+	 * remove and update (after the node's key has changed) are all O(log n).  The first
+	 * N positions are embedded in the heap, so it only allocates if it grows beyond them,
+	 * into an array twice the size.
+	 * @tparam T The node type, which must derive from HeapNode.
+	 * @tparam Before Returns TRUE if the first node must come out of the heap before the
+	 * second.
+	 */
+	template<typename T, bool (*Before)(const T *, const T *), unsigned int N = SCHED_MAX_ENTITIES>
+	class IndexedHeap {
+	public:
+		IndexedHeap() : _nodes(_initial_nodes), _capacity(N), _count(0) { }
+
+		~IndexedHeap()
+		{
+			if (_nodes != _initial_nodes) delete[] _nodes;
+		}
+
+		/**
+		 * Inserts a node into the heap.
+		 * @param node The node to insert, which must not already be in a heap.
+		 * @return Returns TRUE if the node was inserted, or FALSE if the heap needed to
+		 * grow, but the memory for it could not be allocated.
+		 */
+		bool insert(T& node)
+		{
+			assert(!node.in_heap());
+
+			if (_count == _capacity && !grow()) return false;
+
+			set(_count++, &node);
+			sift_up(node.heap_index);
+
+			return true;
+		}
+
+		/**
+		 * Makes room in the heap for a number of nodes, so that inserting up to that
+		 * many cannot fail.
+		 * @param capacity The number of nodes to make room for.
+		 * @return Returns TRUE if there is room, or FALSE if the memory for it could not
+		 * be allocated.
+		 */
+		bool reserve(unsigned int capacity)
+		{
+			while (_capacity < capacity) {
+				if (!grow()) return false;
+			}
+
+			return true;
+		}
+
+		void remove(T& node)
+		{
+			assert(node.in_heap());
+
+			unsigned int index = node.heap_index;
+			T *last = _nodes[--_count];
+
+			node.heap_index = HeapNode::NOT_IN_HEAP;
+			if (last == &node) return;
+
+			set(index, last);
+			update(*last);
+		}
+
+		void update(T& node)
+		{
+			sift_up(node.heap_index);
+			sift_down(node.heap_index);
+		}
+
+		T *first() const { return _count ? _nodes[0] : NULL; }
+		T *at(unsigned int index) const { return _nodes[index]; }
+
+		unsigned int count() const { return _count; }
+		bool empty() const { return _count == 0; }
+
+	private:
+		void set(unsigned int index, T *node)
+		{
+			_nodes[index] = node;
+			node->heap_index = index;
+		}
+
+		void sift_up(unsigned int index)
+		{
+			T *node = _nodes[index];
+
+			while (index > 0) {
+				unsigned int parent = (index - 1) / 2;
+				if (!Before(node, _nodes[parent])) break;
+
+				set(index, _nodes[parent]);
+				index = parent;
+			}
+
+			set(index, node);
+		}
+
+		void sift_down(unsigned int index)
+		{
+			T *node = _nodes[index];
+
+			for (;;) {
+				unsigned int child = (index * 2) + 1;
+				if (child >= _count) break;
+
+				if (child + 1 < _count && Before(_nodes[child + 1], _nodes[child])) child++;
+				if (!Before(_nodes[child], node)) break;
+
+				set(index, _nodes[child]);
+				index = child;
+			}
+
+			set(index, node);
+		}
+
+		/**
+		 * Moves the heap into an array twice the size of the current one.
+		 * @return Returns TRUE if the heap grew, or FALSE if the memory for it could not
+		 * be allocated.
+		 */
+		bool grow()
+		{
+			T **nodes = new T *[_capacity * 2];
+			if (!nodes) return false;
+
+			for (unsigned int i = 0; i < _count; i++) {
+				nodes[i] = _nodes[i];
+			}
+
+			if (_nodes != _initial_nodes) delete[] _nodes;
+
+			_nodes = nodes;
+			_capacity *= 2;
+
+			return true;
+		}
+
+		T **_nodes;
+		T *_initial_nodes[N];
+		unsigned int _capacity;
+		unsigned int _count;
+	};
+
+	/**
+	 * The per-entity state a scheduling algorithm keeps.  Algorithms derive their own
+	 * record type from this, adding whatever per-entity fields they need.
+	 */
+	struct EntityRecord : public RunqueueNode {
+		EntityRecord() : entity(NULL), next_free(NULL) { }
+
+		infos::kernel::SchedulingEntity *entity;
+
+		// The next record on the table's free list, while this one is not in use.
+		EntityRecord *next_free;
+	};
+
+	/**
+	 * A table that associates scheduling entities with their records.  The first N
+	 * records and the open-addressed index that finds them are embedded in the table,
+	 * so lookups, insertions and releases are (expected) O(1) and, up to N entities,
+	 * never touch the heap.  Beyond that, the table grows: records are added a chunk of
+	 * N at a time, and the index is rehashed into one twice the size.  The slots that
+	 * released records leave behind count towards the index's load too, but when they
+	 * make up most of it, the index is cleaned up in place instead of growing.
+	 *
+	 * The SchedulingEntity class itself belongs to the kernel, so this is where an
+	 * algorithm's per-entity fields (including its runqueue links) live.  Records never
+	 * move once allocated, so pointers to them stay valid as the table grows, and
+	 * released records are kept for reuse rather than freed.
+	 *
+	 * Lookups are lock-free, and may run concurrently on any CPU, even while the index is
+	 * being replaced.  A replaced index is kept (unchanged) until the table is destroyed,
+	 * so that a lookup still walking it can finish; as each index is twice the size of
+	 * the one before, together they never take more memory than the current one.  A
+	 * lookup that races with an in-place clean-up retries.  Creating and releasing
+	 * records must be serialised by the caller.
+	 */
+	template<typename T, unsigned int N = SCHED_MAX_ENTITIES>
+	class EntityTable {
+	public:
+		EntityTable() : _index(&_initial_index), _generation(0), _free(NULL), _chunks(NULL), _nr_fresh(0), _nr_records(0),
+			_nr_tombstones(0)
+		{
+			_initial_index.slots = _initial_slots;
+			_initial_index.size = ARRAY_SIZE(_initial_slots);
+			_initial_index.replaced = NULL;
+
+			for (unsigned int i = 0; i < ARRAY_SIZE(_initial_slots); i++) {
+				_initial_slots[i] = NULL;
+			}
+
+			_fresh = _records;
+		}
+
+		~EntityTable()
+		{
+			while (_index != &_initial_index) {
+				Index *index = _index;
+				_index = index->replaced;
+
+				delete[] index->slots;
+				delete index;
+			}
+
+			while (_chunks) {
+				Chunk *chunk = _chunks;
+				_chunks = chunk->next;
+
+				delete chunk;
+			}
+		}
+
+		/**
+		 * Looks up the record for an entity.
+		 * @param entity The entity to look up.
+		 * @return Returns the entity's record, or NULL if it does not have one.
+		 */
+		T *get(const infos::kernel::SchedulingEntity& entity)
+		{
+			for (;;) {
+				// A record that is found is always the right one, but an in-place
+				// clean-up can move a record past a lookup that is walking the index,
+				// so a miss only counts if no clean-up started or finished meanwhile.
+				unsigned int generation = __atomic_load_n(&_generation, __ATOMIC_ACQUIRE);
+
+				T *record = find(entity);
+				if (record) return record;
+
+				__atomic_thread_fence(__ATOMIC_ACQUIRE);
+				if (!(generation & 1) && __atomic_load_n(&_generation, __ATOMIC_RELAXED) == generation) return NULL;
+
+				asm volatile("pause");
+			}
+		}
+
+		/**
+		 * Looks up the record for an entity, creating a fresh one if the entity does
+		 * not have one yet.
+		 * @param entity The entity to look up.
+		 * @return Returns the entity's record, or NULL if the table needed to grow, but
+		 * the memory for it could not be allocated.
+		 */
+		T *get_or_create(infos::kernel::SchedulingEntity& entity)
+		{
+			T *record = get(entity);
+			if (record) return record;
+
+			// Keep the index at most half full, counting the tombstones, so that
+			// every probe path ends, and stays short.  If it is mostly tombstones,
+			// clearing them out is enough.
+			if ((_nr_records + _nr_tombstones + 1) * 2 > _index->size) {
+				if (_nr_tombstones >= _nr_records) {
+					purge_tombstones();
+				} else if (!grow_index()) {
+					return NULL;
+				}
+			}
+
+			record = alloc_record();
+			if (!record) return NULL;
+
+			*record = T();
+			record->entity = &entity;
+
+			// Find the first free slot on the probe path (the entity is known to be
+			// absent, so a tombstone can be reused).
+			Index *index = _index;
+			unsigned int slot = hash(&entity, index->size);
+			while (index->slots[slot] != NULL && index->slots[slot] != tombstone()) {
+				slot = (slot + 1) % index->size;
+			}
+
+			if (index->slots[slot] == tombstone()) _nr_tombstones--;
+
+			// Publish the slot only once the record is ready for lock-free readers.
+			__atomic_store_n(&index->slots[slot], record, __ATOMIC_RELEASE);
+			_nr_records++;
+
+			return record;
+		}
+
+		/**
+		 * Releases a record back to the table.  The record must not be queued.
+		 * @param record The record to release.
+		 */
+		void release(T *record)
+		{
+			assert(!record->queued());
+
+			Index *index = _index;
+			unsigned int slot = hash(record->entity, index->size);
+
+			while (index->slots[slot] != record) {
+				slot = (slot + 1) % index->size;
+			}
+
+			// If the following slot terminates the probe chain, then this slot (and
+			// any tombstones immediately before it) can terminate the chain instead.
+			if (index->slots[(slot + 1) % index->size] == NULL) {
+				__atomic_store_n(&index->slots[slot], (T *) NULL, __ATOMIC_RELEASE);
+				slot = (slot + index->size - 1) % index->size;
+
+				while (index->slots[slot] == tombstone()) {
+					__atomic_store_n(&index->slots[slot], (T *) NULL, __ATOMIC_RELEASE);
+					slot = (slot + index->size - 1) % index->size;
+					_nr_tombstones--;
+				}
+			} else {
+				__atomic_store_n(&index->slots[slot], tombstone(), __ATOMIC_RELEASE);
+				_nr_tombstones++;
+			}
+
+			record->entity = NULL;
+			record->next_free = _free;
+			_free = record;
+			_nr_records--;
+		}
+
+		/**
+		 * Returns the number of records currently in use.
+		 */
+		unsigned int count() const { return _nr_records; }
+
+	private:
+		/**
+		 * An open-addressed index of records, which are found by hashing the address
+		 * of their entity.
+		 */
+		struct Index {
+			T **slots;
+			unsigned int size;
+
+			// The index that this one replaced, which is kept for lookups that may
+			// still be walking it.
+			Index *replaced;
+		};
+
+		/**
+		 * A block of records allocated once the embedded records have run out.
+		 */
+		struct Chunk {
+			Chunk *next;
+			T records[N];
+		};
+
+		// Marks a slot whose record was released, but which may be part of another
+		// record's probe path.
+		static T *tombstone() { return (T *) 1; }
+
+		static unsigned int hash(const infos::kernel::SchedulingEntity *entity, unsigned int size)
+		{
+			// Entities are heap objects, so discard the alignment bits and scramble
+			// the rest with a multiplicative hash.
+			uint64_t key = ((uint64_t) entity) >> 4;
+			return (unsigned int) ((key * 0x9e3779b97f4a7c15ULL) >> 32) % size;
+		}
+
+		/**
+		 * Walks the probe path for an entity in the current index.
+		 * @return Returns the entity's record, or NULL if it was not found.
+		 */
+		T *find(const infos::kernel::SchedulingEntity& entity) const
+		{
+			const Index *index = __atomic_load_n(&_index, __ATOMIC_ACQUIRE);
+			unsigned int slot = hash(&entity, index->size);
+
+			for (unsigned int i = 0; i < index->size; i++) {
+				T *record = __atomic_load_n(&index->slots[slot], __ATOMIC_ACQUIRE);
+
+				if (record == NULL) {
+					return NULL;
+				} else if (record != tombstone() && record->entity == &entity) {
+					return record;
+				}
+
+				slot = (slot + 1) % index->size;
+			}
+
+			return NULL;
+		}
+
+		/**
+		 * Takes a record from the free list, or a fresh one from the current chunk,
+		 * allocating another chunk if that has run out.
+		 * @return Returns the record, or NULL if a chunk could not be allocated.
+		 */
+		T *alloc_record()
+		{
+			if (_free) {
+				T *record = static_cast<T *>(_free);
+				_free = record->next_free;
+
+				return record;
+			}
+
+			if (_nr_fresh == N) {
+				Chunk *chunk = new Chunk();
+				if (!chunk) return NULL;
+
+				chunk->next = _chunks;
+				_chunks = chunk;
+
+				_fresh = chunk->records;
+				_nr_fresh = 0;
+			}
+
+			return &_fresh[_nr_fresh++];
+		}
+
+		/**
+		 * Rehashes the records into a new index twice the size of the current one, and
+		 * then publishes it.  The old index is left as it is, for lookups that are still
+		 * walking it.
+		 * @return Returns TRUE if the index was replaced, or FALSE if the memory for the
+		 * new one could not be allocated.
+		 */
+		bool grow_index()
+		{
+			Index *old = _index;
+
+			Index *index = new Index();
+			if (!index) return false;
+
+			index->size = old->size * 2;
+			index->slots = new T *[index->size];
+			if (!index->slots) {
+				delete index;
+				return false;
+			}
+
+			for (unsigned int i = 0; i < index->size; i++) {
+				index->slots[i] = NULL;
+			}
+
+			for (unsigned int i = 0; i < old->size; i++) {
+				T *record = old->slots[i];
+				if (record == NULL || record == tombstone()) continue;
+
+				unsigned int slot = hash(record->entity, index->size);
+				while (index->slots[slot] != NULL) {
+					slot = (slot + 1) % index->size;
+				}
+
+				index->slots[slot] = record;
+			}
+
+			index->replaced = old;
+			__atomic_store_n(&_index, index, __ATOMIC_RELEASE);
+
+			_nr_tombstones = 0;
+			return true;
+		}
+
+		/**
+		 * Clears the tombstones out of the current index, by emptying them and then
+		 * re-inserting every record that could have been reached past one.  Lookups are
+		 * told to retry for the duration, through the generation count.
+		 */
+		void purge_tombstones()
+		{
+			Index *index = _index;
+
+			__atomic_store_n(&_generation, _generation + 1, __ATOMIC_RELAXED);
+			__atomic_thread_fence(__ATOMIC_RELEASE);
+
+			// No probe path runs through a slot that was already empty, so starting
+			// just after one, moving each record back to the first empty slot on its
+			// path never breaks the path of a record that has already been moved.
+			unsigned int start = 0;
+			for (unsigned int i = 0; i < index->size; i++) {
+				if (index->slots[i] == NULL) start = i;
+			}
+
+			for (unsigned int i = 0; i < index->size; i++) {
+				if (index->slots[i] == tombstone()) {
+					__atomic_store_n(&index->slots[i], (T *) NULL, __ATOMIC_RELAXED);
+				}
+			}
+
+			for (unsigned int i = 1; i <= index->size; i++) {
+				unsigned int slot = (start + i) % index->size;
+
+				T *record = index->slots[slot];
+				if (record == NULL) continue;
+
+				unsigned int target = hash(record->entity, index->size);
+				while (target != slot && index->slots[target] != NULL) {
+					target = (target + 1) % index->size;
+				}
+
+				if (target != slot) {
+					__atomic_store_n(&index->slots[target], record, __ATOMIC_RELAXED);
+					__atomic_store_n(&index->slots[slot], (T *) NULL, __ATOMIC_RELAXED);
+				}
+			}
+
+			_nr_tombstones = 0;
+
+			__atomic_thread_fence(__ATOMIC_RELEASE);
+			__atomic_store_n(&_generation, _generation + 1, __ATOMIC_RELAXED);
+		}
+
+		Index *_index;
+		Index _initial_index;
+		T *_initial_slots[N * 2];
+
+		// Odd while the current index is being cleaned up in place, and bumped on
+		// either side of each clean-up.
+		unsigned int _generation;
+
+		// Released records, which are reused before any fresh ones.
+		EntityRecord *_free;
+
+		// The records that have not been handed out yet are those after the first
+		// _nr_fresh in _fresh, which is either the embedded records or the newest chunk.
+		T _records[N];
+		Chunk *_chunks;
+		T *_fresh;
+		unsigned int _nr_fresh;
+
+		unsigned int _nr_records;
+
+		// The number of tombstones in the current index.
+		unsigned int _nr_tombstones;
+	};
+}
+
+#endif /* SCHED_RUNQUEUE_H */
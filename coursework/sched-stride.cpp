@@ -0,0 +1,278 @@
+/*
+ * Stride (Proportional-share) Scheduling Algorithm
+ */
+#include <infos/kernel/sched.h>
+#include <infos/kernel/thread.h>
+#include <infos/kernel/log.h>
+#include <infos/util/lock.h>
+
+#include "sched-runqueue.h"
+#include "sched-control.h"
+
+using namespace infos::kernel;
+using namespace infos::util;
+using namespace sched;
+
+// The stride of an entity holding a single ticket.
+#define STRIDE1			(1ULL << 20)
+
+// The number of tickets an entity holds until it is told otherwise.
+#define STRIDE_DEFAULT_TICKETS	100
+
+// The amount of CPU time (in nanoseconds) that advances an entity's pass by one stride.
+#define STRIDE_QUANTUM		1000000ULL
+
+// How often (in nanoseconds) the share accounting is logged.
+#define STRIDE_STATS_INTERVAL	1000000000ULL
+
+/**
+ * A stride scheduling algorithm.  Each entity's pass advances by its stride (which is
+ * inversely proportional to its tickets) for every quantum of CPU time it uses, and the
+ * entity with the lowest pass always runs next.  Runnable entities are kept in a min-heap
+ * ordered by pass, so every operation is O(log n).
+ */
+class StrideScheduler : public SchedulingAlgorithm
+{
+public:
+	StrideScheduler() : current(NULL), global_pass(0), last_stats(0)
+	{
+	  instance = this;
+	}
+
+	/**
+	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
+	 */
+	const char* name() const override { return "stride"; }
+
+	/**
+	 * Called when a scheduling entity becomes eligible for running.
+	 * @param entity
+	 */
+	void add_to_runqueue(SchedulingEntity& entity) override
+	{
+	  UniqueIRQLock l;
+
+	  StrideEntity *record = entities.get_or_create(entity);
+	  if (!record) {
+	    refuse_entity("stride", entity);
+	    return;
+	  }
+
+	  if (record->in_heap()) return;
+
+	  // Rejoin relative to the global pass, keeping whatever lead or lag the entity had
+	  // when it left.  That way sleeping neither banks credit nor costs a penalty.
+	  record->pass = global_pass + record->remain;
+	  if (!runnable.insert(*record)) refuse_entity("stride", entity);
+	}
+
+	/**
+	 * Called when a scheduling entity is no longer eligible for running.
+	 * @param entity
+	 */
+	void remove_from_runqueue(SchedulingEntity& entity) override
+	{
+	  UniqueIRQLock l;
+
+	  StrideEntity *record = entities.get(entity);
+	  if (!record) return;
+
+	  if (record == current) {
+	    charge(*record);
+	    current = NULL;
+	  }
+
+	  if (record->in_heap()) {
+	    record->remain = (int64_t) (record->pass - global_pass);
+	    runnable.remove(*record);
+	  }
+
+	  // A stopped entity will never be added back, so give its record up.
+	  if (entity.stopped()) entities.release(record);
+	}
+
+	/**
+	 * Called every time a scheduling event occurs, to cause the next eligible entity
+	 * to be chosen.  This is always the runnable entity with the lowest pass.
+	 */
+	SchedulingEntity *pick_next_entity() override
+	{
+	  uint64_t now = sched::now();
+	  if (now - last_stats >= STRIDE_STATS_INTERVAL) {
+	    last_stats = now;
+	    dump_state();
+	  }
+
+	  if (current) charge(*current);
+
+	  StrideEntity *next = runnable.first();
+	  if (!next) {
+	    current = NULL;
+	    return NULL;
+	  }
+
+	  // The global pass tracks the minimum pass, and never goes backwards.
+	  if ((int64_t) (next->pass - global_pass) > 0) global_pass = next->pass;
+
+	  if (next != current) {
+	    next->runtime_mark = runtime_of(*next->entity);
+	    current = next;
+	  }
+
+	  next->picks++;
+	  return next->entity;
+	}
+
+	/**
+	 * Changes the number of tickets an entity holds.  A runnable entity's remaining
+	 * pass is rescaled to the new stride, as if it had always held the new tickets.
+	 */
+	bool set_tickets(SchedulingEntity& entity, unsigned int tickets)
+	{
+	  if (tickets == 0 || tickets > STRIDE1) return false;
+
+	  UniqueIRQLock l;
+
+	  // The record is not created here, as it would leak for an entity that never
+	  // becomes runnable (and so never stops).
+	  StrideEntity *record = entities.get(entity);
+	  if (!record) return false;
+
+	  uint64_t old_stride = record->stride;
+	  record->tickets = tickets;
+	  record->stride = STRIDE1 / tickets;
+
+	  // The carried part of a step is rescaled along with the rest of the pass.
+	  uint64_t rem = (record->pass_rem * record->stride) / old_stride;
+	  record->pass_rem = rem % STRIDE_QUANTUM;
+
+	  if (record->in_heap()) {
+	    int64_t remain = (int64_t) (record->pass - global_pass);
+	    record->pass = global_pass + (remain * (int64_t) record->stride) / (int64_t) old_stride + rem / STRIDE_QUANTUM;
+	    runnable.update(*record);
+	  } else {
+	    record->remain = (record->remain * (int64_t) record->stride) / (int64_t) old_stride + rem / STRIDE_QUANTUM;
+	  }
+
+	  return true;
+	}
+
+	/**
+	 * Retrieves the accounting kept for an entity.
+	 */
+	bool get_stats(SchedulingEntity& entity, StrideStats& stats)
+	{
+	  UniqueIRQLock l;
+
+	  StrideEntity *record = entities.get(entity);
+	  if (!record) return false;
+
+	  stats.tickets = record->tickets;
+	  stats.runtime = record->runtime;
+	  stats.picks = record->picks;
+
+	  return true;
+	}
+
+	/**
+	 * Logs the configured and achieved CPU share of every runnable entity.
+	 */
+	void dump_state()
+	{
+	  uint64_t total_tickets = 0, total_runtime = 0;
+	  for (unsigned int i = 0; i < runnable.count(); i++) {
+	    total_tickets += runnable.at(i)->tickets;
+	    total_runtime += runnable.at(i)->runtime;
+	  }
+
+	  if (total_tickets == 0 || total_runtime == 0) return;
+
+	  for (unsigned int i = 0; i < runnable.count(); i++) {
+	    const StrideEntity *record = runnable.at(i);
+
+	    sched_log.messagef(LogLevel::DEBUG, "stride: entity=%p tickets=%u configured=%lu%% achieved=%lu%% picks=%lu",
+	      record->entity, record->tickets, (record->tickets * 100) / total_tickets,
+	      (record->runtime * 100) / total_runtime, record->picks);
+	  }
+	}
+
+	// The registered instance of this algorithm.
+	static StrideScheduler *instance;
+
+private:
+	/**
+	 * The per-entity state kept by the stride scheduler.
+	 */
+	struct StrideEntity : public EntityRecord, public HeapNode {
+	  StrideEntity()
+	    : tickets(STRIDE_DEFAULT_TICKETS), stride(STRIDE1 / STRIDE_DEFAULT_TICKETS), pass(0), pass_rem(0),
+	      remain(0), runtime_mark(0), runtime(0), picks(0) { }
+
+	  unsigned int tickets;
+	  uint64_t stride, pass;
+
+	  // The part of a pass step (in 1/STRIDE_QUANTUM units) that the entity has been
+	  // charged for, but that has not yet added up to a whole step of its pass.
+	  uint64_t pass_rem;
+
+	  // The entity's pass relative to the global pass, when it last left the heap.
+	  int64_t remain;
+
+	  // The entity's total CPU time when it was last charged, and the accounting.
+	  uint64_t runtime_mark, runtime;
+	  unsigned long picks;
+	};
+
+	static bool before(const StrideEntity *a, const StrideEntity *b)
+	{
+	  // Compare with wrap-around, so that passes may overflow safely.
+	  return (int64_t) (a->pass - b->pass) < 0;
+	}
+
+	/**
+	 * Charges an entity for the CPU time it has used since it was last charged, by
+	 * advancing its pass in proportion to its stride.
+	 */
+	void charge(StrideEntity& record)
+	{
+	  uint64_t runtime = runtime_of(*record.entity);
+	  uint64_t used = runtime - record.runtime_mark;
+
+	  record.runtime_mark = runtime;
+	  record.runtime += used;
+
+	  // Short bursts advance the pass by less than a step, so the remainder is carried
+	  // over instead of being dropped, which would let such entities run for free.
+	  uint64_t advance = (used * record.stride) + record.pass_rem;
+	  record.pass += advance / STRIDE_QUANTUM;
+	  record.pass_rem = advance % STRIDE_QUANTUM;
+
+	  if (record.in_heap()) runnable.update(record);
+	}
+
+	// The per-entity records.
+	EntityTable<StrideEntity> entities;
+
+	// The min-heap of runnable entities, ordered by pass.
+	IndexedHeap<StrideEntity, before> runnable;
+
+	// The entity that was picked last time.
+	StrideEntity *current;
+
+	uint64_t global_pass;
+	uint64_t last_stats;
+};
+
+StrideScheduler *StrideScheduler::instance;
+
+bool sched::set_tickets(SchedulingEntity& entity, unsigned int tickets)
+{
+  return StrideScheduler::instance->set_tickets(entity, tickets);
+}
+
+bool sched::get_stride_stats(SchedulingEntity& entity, StrideStats& stats)
+{
+  return StrideScheduler::instance->get_stats(entity, stats);
+}
+
+RegisterScheduler(StrideScheduler);
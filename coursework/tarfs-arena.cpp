@@ -0,0 +1,59 @@
+/*
+ * TAR File-system Metadata Arena
+ */
+#include "tarfs-arena.h"
+#include <infos/kernel/kernel.h>
+#include <infos/mm/mm.h>
+
+using namespace infos::kernel;
+using namespace infos::mm;
+using namespace tarfs;
+
+void *Arena::alloc(size_t size, size_t align)
+{
+  uintptr_t next = ((uintptr_t) _next + (align - 1)) & ~(uintptr_t) (align - 1);
+
+  if (!_next || next + size > (uintptr_t) _end) {
+    // Start a new chunk, which is made bigger than usual if the allocation would
+    // not fit in one.  Whatever is left of the current chunk goes unused.
+    int order = TARFS_ARENA_ORDER;
+    while (((size_t) __page_size << order) < sizeof(Chunk) + align + size) {
+      order++;
+    }
+
+    PageDescriptor *pgd = sys.mm().pgalloc().alloc_pages(order);
+    if (!pgd) return NULL;
+
+    Chunk *chunk = (Chunk *) sys.mm().pgalloc().pgd_to_vpa(pgd);
+    chunk->pgd = pgd;
+    chunk->order = order;
+    chunk->next = _chunks;
+    _chunks = chunk;
+
+    _next = (uint8_t *) (chunk + 1);
+    _end = (uint8_t *) chunk + ((size_t) __page_size << order);
+    _allocated += (size_t) __page_size << order;
+
+    next = ((uintptr_t) _next + (align - 1)) & ~(uintptr_t) (align - 1);
+  }
+
+  _next = (uint8_t *) (next + size);
+  _used += size;
+
+  return (void *) next;
+}
+
+void Arena::release()
+{
+  while (_chunks) {
+    Chunk *chunk = _chunks;
+    _chunks = chunk->next;
+
+    sys.mm().pgalloc().free_pages(chunk->pgd, chunk->order);
+  }
+
+  _next = NULL;
+  _end = NULL;
+  _allocated = 0;
+  _used = 0;
+}
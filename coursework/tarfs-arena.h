@@ -0,0 +1,59 @@
+/*
+ * TAR File-system Metadata Arena
+ */
+#ifndef TARFS_ARENA_H
+#define TARFS_ARENA_H
+
+#include <infos/define.h>
+#include <infos/mm/page-allocator.h>
+
+// The size of each chunk of an arena, as a power of two number of pages.
+#define TARFS_ARENA_ORDER	4
+
+namespace tarfs {
+
+	/**
+	 * A bump allocator for metadata that lives exactly as long as a mount.  Memory is
+	 * carved out of chunks taken from the page allocator, is never freed piece by
+	 * piece, and is all given back at once by release().
+	 */
+	class Arena {
+	public:
+		Arena() : _chunks(NULL), _next(NULL), _end(NULL), _allocated(0), _used(0) { }
+		~Arena() { release(); }
+
+		/**
+		 * Allocates memory from the arena.
+		 * @param size The number of bytes to allocate.
+		 * @param align The alignment of the allocation, which must be a power of two.
+		 * @return Returns the memory, or NULL if no more pages could be allocated.
+		 */
+		void *alloc(size_t size, size_t align = sizeof(void *));
+
+		/**
+		 * Gives every chunk back to the page allocator.
+		 */
+		void release();
+
+		// The number of bytes taken from the page allocator, and the number of those
+		// that have been handed out.
+		size_t allocated() const { return _allocated; }
+		size_t used() const { return _used; }
+
+	private:
+		/**
+		 * The header at the start of each chunk.
+		 */
+		struct Chunk {
+			infos::mm::PageDescriptor *pgd;
+			int order;
+			Chunk *next;
+		};
+
+		Chunk *_chunks;
+		uint8_t *_next, *_end;
+		size_t _allocated, _used;
+	};
+}
+
+#endif /* TARFS_ARENA_H */
@@ -0,0 +1,270 @@
+/*
+ * TAR File-system Block Cache
+ */
+#include "tarfs-cache.h"
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/log.h>
+#include <infos/mm/mm.h>
+#include <infos/util/string.h>
+
+using namespace infos::drivers::block;
+using namespace infos::kernel;
+using namespace infos::mm;
+using namespace infos::util;
+using namespace tarfs;
+
+BlockCache::BlockCache(BlockDevice& bdev, unsigned int nr_blocks)
+  : _bdev(bdev),
+    _block_size(bdev.block_size()),
+    _slots(NULL),
+    _nr_slots(0),
+    _hand(0),
+    _buckets(NULL),
+    _nr_buckets(1),
+    _pages(NULL),
+    _nr_pages(0),
+    _staging(NULL),
+    _max_prefetch(0),
+    _hits(0),
+    _misses(0),
+    _prefetched(0)
+{
+  unsigned int blocks_per_page = __page_size / _block_size;
+  if (blocks_per_page == 0) return;
+
+  unsigned int nr_pages = (nr_blocks + blocks_per_page - 1) / blocks_per_page;
+  if (nr_pages == 0) return;
+
+  // Take the pages that hold the data from the page allocator, one at a time, so
+  // that a large cache does not need physically contiguous memory.  If memory runs
+  // out, make do with the pages already allocated.  Without any slots at all, reads
+  // just pass straight through.
+  _pages = new PageDescriptor *[nr_pages];
+  if (!_pages) return;
+
+  while (_nr_pages < nr_pages) {
+    PageDescriptor *pgd = sys.mm().pgalloc().alloc_pages(0);
+    if (!pgd) break;
+
+    _pages[_nr_pages++] = pgd;
+  }
+
+  unsigned int nr_slots = _nr_pages * blocks_per_page;
+  if (nr_slots == 0) return;
+
+  // Use about one bucket per slot, so that chains stay short.
+  while (_nr_buckets < nr_slots) {
+    _nr_buckets <<= 1;
+  }
+
+  _slots = new Slot[nr_slots];
+  _buckets = new Slot *[_nr_buckets];
+  if (!_slots || !_buckets) return;
+
+  _nr_slots = nr_slots;
+  for (unsigned int i = 0; i < _nr_slots; i++) {
+    _slots[i].block = 0;
+    _slots[i].valid = false;
+    _slots[i].referenced = false;
+    _slots[i].hash_next = NULL;
+    _slots[i].data = (uint8_t *) sys.mm().pgalloc().pgd_to_vpa(_pages[i / blocks_per_page]) + ((i % blocks_per_page) * _block_size);
+  }
+
+  for (unsigned int i = 0; i < _nr_buckets; i++) {
+    _buckets[i] = NULL;
+  }
+
+  // Prefetching is only worthwhile if the blocks it brings in are not pushed straight
+  // back out again, so never prefetch more than half of the cache at once.
+  _staging = sys.mm().pgalloc().alloc_pages(TARFS_CACHE_PREFETCH_ORDER);
+  if (_staging) {
+    _max_prefetch = ((1u << TARFS_CACHE_PREFETCH_ORDER) * __page_size) / _block_size;
+    if (_max_prefetch > _nr_slots / 2) {
+      _max_prefetch = _nr_slots / 2;
+    }
+  }
+}
+
+BlockCache::~BlockCache()
+{
+  for (unsigned int i = 0; i < _nr_pages; i++) {
+    sys.mm().pgalloc().free_pages(_pages[i], 0);
+  }
+
+  if (_staging) {
+    sys.mm().pgalloc().free_pages(_staging, TARFS_CACHE_PREFETCH_ORDER);
+  }
+
+  delete[] _pages;
+  delete[] _slots;
+  delete[] _buckets;
+}
+
+bool BlockCache::read_blocks(void *buffer, size_t offset, size_t count)
+{
+  // Without any slots, there is nothing to do but pass the read on.
+  if (_nr_slots == 0) return _bdev.read_blocks(buffer, offset, count);
+
+  UniqueLock<Mutex> l(_lock);
+
+  uint8_t *out = (uint8_t *) buffer;
+  size_t end = offset + count;
+  size_t block = offset;
+
+  while (block < end) {
+    Slot *slot = lookup(block);
+    if (slot) {
+      memcpy(out, slot->data, _block_size);
+      slot->referenced = true;
+
+      _hits++;
+      out += _block_size;
+      block++;
+      continue;
+    }
+
+    // Find the run of blocks that are not cached, and read it all in one go.
+    size_t run_end = block + 1;
+    while (run_end < end && !lookup(run_end)) {
+      run_end++;
+    }
+
+    size_t run = run_end - block;
+    if (!_bdev.read_blocks(out, block, run)) return false;
+
+    _misses += run;
+
+    // A run longer than the cache would only push its own start back out, so only
+    // keep the end of it.
+    size_t skip = run > _nr_slots ? run - _nr_slots : 0;
+    for (size_t i = skip; i < run; i++) {
+      insert(block + i, out + (i * _block_size));
+    }
+
+    out += run * _block_size;
+    block = run_end;
+  }
+
+  return true;
+}
+
+bool BlockCache::prefetch(size_t offset, size_t count)
+{
+  if (count > _max_prefetch) {
+    count = _max_prefetch;
+  }
+
+  if (count == 0) return true;
+
+  UniqueLock<Mutex> l(_lock);
+
+  uint8_t *staging = (uint8_t *) sys.mm().pgalloc().pgd_to_vpa(_staging);
+  size_t end = offset + count;
+  size_t block = offset;
+
+  while (block < end) {
+    if (lookup(block)) {
+      block++;
+      continue;
+    }
+
+    size_t run_end = block + 1;
+    while (run_end < end && !lookup(run_end)) {
+      run_end++;
+    }
+
+    size_t run = run_end - block;
+    if (!_bdev.read_blocks(staging, block, run)) return false;
+
+    _prefetched += run;
+
+    // The prefetched blocks have not been used yet, so they are the first candidates
+    // for replacement if they never are.
+    for (size_t i = 0; i < run; i++) {
+      insert(block + i, staging + (i * _block_size));
+    }
+
+    block = run_end;
+  }
+
+  return true;
+}
+
+/**
+ * Logs the cache's hit and miss counts, and how many blocks have been prefetched.
+ */
+void BlockCache::dump_stats() const
+{
+  uint64_t total = _hits + _misses;
+
+  syslog.messagef(LogLevel::DEBUG, "tarfs: cache blocks=%u hits=%lu misses=%lu hit-rate=%lu%% prefetched=%lu",
+    _nr_slots, _hits, _misses, total ? (_hits * 100) / total : 0, _prefetched);
+}
+
+/**
+ * Finds the slot that holds a block.
+ * @return Returns the slot, or NULL if the block is not cached.
+ */
+BlockCache::Slot *BlockCache::lookup(size_t block) const
+{
+  for (Slot *slot = *bucket_of(block); slot; slot = slot->hash_next) {
+    if (slot->block == block) return slot;
+  }
+
+  return NULL;
+}
+
+/**
+ * Caches a copy of a block that has just been read from the device.
+ */
+void BlockCache::insert(size_t block, const void *data)
+{
+  Slot *slot = evict();
+
+  slot->block = block;
+  slot->valid = true;
+  slot->referenced = false;
+  memcpy(slot->data, data, _block_size);
+
+  Slot **bucket = bucket_of(block);
+  slot->hash_next = *bucket;
+  *bucket = slot;
+}
+
+/**
+ * Sweeps the CLOCK hand round to find a slot to reuse, giving every recently used
+ * block a second chance.
+ * @return Returns the slot, which is no longer in the hash table.
+ */
+BlockCache::Slot *BlockCache::evict()
+{
+  while (true) {
+    Slot *slot = &_slots[_hand];
+    _hand = (_hand + 1) % _nr_slots;
+
+    if (!slot->valid) return slot;
+
+    if (slot->referenced) {
+      slot->referenced = false;
+      continue;
+    }
+
+    unhash(slot);
+    slot->valid = false;
+    return slot;
+  }
+}
+
+/**
+ * Takes a slot out of its hash bucket.
+ */
+void BlockCache::unhash(Slot *slot)
+{
+  Slot **link = bucket_of(slot->block);
+  while (*link != slot) {
+    link = &(*link)->hash_next;
+  }
+
+  *link = slot->hash_next;
+  slot->hash_next = NULL;
+}
@@ -0,0 +1,114 @@
+/*
+ * TAR File-system Block Cache
+ */
+#ifndef TARFS_CACHE_H
+#define TARFS_CACHE_H
+
+#include <infos/drivers/block/block-device.h>
+#include <infos/mm/page-allocator.h>
+#include <infos/util/lock.h>
+
+// The most blocks that can be prefetched into the cache with one request, as a power
+// of two number of pages.
+#define TARFS_CACHE_PREFETCH_ORDER	5
+
+namespace tarfs {
+
+	/**
+	 * A cache of device blocks, which sits between the file-system and its block
+	 * device.  The cached blocks live in pages taken from the page allocator, and a
+	 * CLOCK sweep picks which block to replace when the cache is full.
+	 */
+	class BlockCache {
+	public:
+		/**
+		 * Creates a cache for a block device.
+		 * @param bdev The block device to cache.
+		 * @param nr_blocks The number of blocks the cache should hold.  The cache
+		 * may end up smaller, if the pages for it cannot all be allocated.
+		 */
+		BlockCache(infos::drivers::block::BlockDevice& bdev, unsigned int nr_blocks);
+		~BlockCache();
+
+		/**
+		 * Reads blocks through the cache.  Blocks that are cached are copied out of
+		 * the cache, and each run of blocks that are not is read from the device
+		 * straight into the buffer, with a single request, and then cached.
+		 * @param buffer The buffer to read the blocks into.
+		 * @param offset The first block to read.
+		 * @param count The number of blocks to read.
+		 * @return Returns TRUE if every block was read, or FALSE otherwise.
+		 */
+		bool read_blocks(void *buffer, size_t offset, size_t count);
+
+		/**
+		 * Reads blocks into the cache, ahead of them being needed, so that they are
+		 * read with one large request rather than several small ones.  Blocks that are
+		 * already cached are skipped.
+		 * @param offset The first block to read.
+		 * @param count The number of blocks to read, which is capped at max_prefetch().
+		 * @return Returns TRUE if every block was read, or FALSE otherwise.
+		 */
+		bool prefetch(size_t offset, size_t count);
+
+		unsigned int capacity() const { return _nr_slots; }
+		unsigned int max_prefetch() const { return _max_prefetch; }
+
+		uint64_t hits() const { return _hits; }
+		uint64_t misses() const { return _misses; }
+		uint64_t prefetched() const { return _prefetched; }
+
+		void dump_stats() const;
+
+	private:
+		/**
+		 * A cached block.
+		 */
+		struct Slot {
+			size_t block;
+			bool valid, referenced;
+
+			// The next slot in the same hash bucket.
+			Slot *hash_next;
+
+			uint8_t *data;
+		};
+
+		Slot *lookup(size_t block) const;
+		void insert(size_t block, const void *data);
+		Slot *evict();
+		void unhash(Slot *slot);
+
+		Slot **bucket_of(size_t block) const
+		{
+			return &_buckets[block & (_nr_buckets - 1)];
+		}
+
+		infos::drivers::block::BlockDevice& _bdev;
+		size_t _block_size;
+
+		// The slots, and the position of the CLOCK hand among them.
+		Slot *_slots;
+		unsigned int _nr_slots, _hand;
+
+		// The hash table that finds the slot for a block.  The number of buckets is
+		// a power of two.
+		Slot **_buckets;
+		unsigned int _nr_buckets;
+
+		// The pages that hold the cached data.
+		infos::mm::PageDescriptor **_pages;
+		unsigned int _nr_pages;
+
+		// The buffer that prefetched blocks are read into, on their way into the
+		// cache.
+		infos::mm::PageDescriptor *_staging;
+		unsigned int _max_prefetch;
+
+		infos::util::Mutex _lock;
+
+		uint64_t _hits, _misses, _prefetched;
+	};
+}
+
+#endif /* TARFS_CACHE_H */
@@ -0,0 +1,77 @@
+/*
+ * TAR File-system Index Format
+ *
+ * An archive may have an index appended to it, after the end of the archive itself,
+ * so that it can be mounted without scanning every header.  The index is a table of
+ * fixed-size entries, followed by the names they refer to, and is found through a
+ * trailer in the last block of the device:
+ *
+ *   | archive ... | entries | names | (padding) | trailer |
+ *
+ * This header is shared with the host-side tool that builds the index, so it only
+ * uses the fixed-width integer types, which the includer must provide.
+ */
+#ifndef TARFS_INDEX_H
+#define TARFS_INDEX_H
+
+// The magic number at the start of the trailer.
+#define TARFS_INDEX_MAGIC		"TARFSIX1"
+#define TARFS_INDEX_MAGIC_SIZE		8
+
+// The types of index entry.
+#define TARFS_INDEX_FILE		0
+#define TARFS_INDEX_DIRECTORY		1
+
+namespace tarfs {
+
+	/**
+	 * The trailer, which occupies the start of the last block of the device.
+	 */
+	struct tarfs_index_trailer {
+		char magic[TARFS_INDEX_MAGIC_SIZE];
+
+		// The number of blocks in the archive that the index describes.
+		uint32_t archive_blocks;
+
+		// The first block of the table, and its size in bytes.
+		uint32_t table_block;
+		uint32_t table_size;
+
+		uint32_t nr_entries;
+
+		// The 32-bit FNV-1a hash of the table.
+		uint32_t checksum;
+	} __attribute__((packed));
+
+	/**
+	 * An entry in the table, describing one member of the archive.
+	 */
+	struct tarfs_index_entry {
+		// The block that the member's data starts at, and its size in bytes.
+		uint32_t data_block;
+		uint32_t size;
+
+		// Where the member's path is, relative to the end of the entries.
+		uint32_t name_offset;
+		uint16_t name_length;
+
+		uint8_t type;
+		uint8_t reserved;
+	} __attribute__((packed));
+
+	/**
+	 * Computes the checksum of an index table.
+	 */
+	static inline uint32_t tarfs_index_checksum(const uint8_t *data, uint32_t size)
+	{
+		uint32_t hash = 0x811c9dc5;
+		for (uint32_t i = 0; i < size; i++) {
+			hash ^= data[i];
+			hash *= 0x01000193;
+		}
+
+		return hash;
+	}
+}
+
+#endif /* TARFS_INDEX_H */
@@ -7,7 +7,9 @@
  * STUDENT NUMBER: s
  */
 #include "tarfs.h"
+#include <infos/kernel/kernel.h>
 #include <infos/kernel/log.h>
+#include <infos/util/cmdline.h>
 
 using namespace infos::fs;
 using namespace infos::drivers;
@@ -16,6 +18,55 @@ using namespace infos::kernel;
 using namespace infos::util;
 using namespace tarfs;
 
+/**
+ * Converts the decimal number at the start of a kernel command-line option's value,
+ * ignoring anything after it.
+ */
+static unsigned long parse_option_number(const char *value)
+{
+  unsigned long n = 0;
+
+  while (*value >= '0' && *value <= '9') {
+    n = (n * 10) + (*value++ - '0');
+  }
+
+  return n;
+}
+
+// The size of the block cache, in kilobytes, which can be changed with the
+// tarfs.cache-size option on the kernel command-line.  Zero turns the cache off.
+static unsigned long tarfs_cache_size = 1024;
+
+RegisterCmdLineArgument(TarFSCacheSize, "tarfs.cache-size") {
+  tarfs_cache_size = parse_option_number(value);
+}
+
+// The largest readahead window, in kilobytes, which can be changed with the
+// tarfs.readahead option on the kernel command-line.  Zero turns readahead off.  The
+// window is also limited by what the block cache can prefetch in one go.
+static unsigned long tarfs_readahead = 128;
+
+RegisterCmdLineArgument(TarFSReadahead, "tarfs.readahead") {
+  tarfs_readahead = parse_option_number(value);
+}
+
+// Whether an index appended to the archive is used to mount it, which can be changed
+// with the tarfs.index option on the kernel command-line.
+static bool tarfs_use_index = true;
+
+RegisterCmdLineArgument(TarFSIndex, "tarfs.index") {
+  tarfs_use_index = strncmp(value, "0", 1) != 0;
+}
+
+// Whether directories are only populated when they are first looked in, rather than
+// all at mount time, which can be changed with the tarfs.lazy option on the kernel
+// command-line.
+static bool tarfs_lazy = false;
+
+RegisterCmdLineArgument(TarFSLazy, "tarfs.lazy") {
+  tarfs_lazy = strncmp(value, "0", 1) != 0;
+}
+
 /**
  * TAR files contain header data encoded as octal values in ASCII.  This function
  * converts this terrible representation into a real unsigned integer.
@@ -83,6 +134,8 @@ namespace tarfs {
 
 /**
  * Reads the contents of the file into the buffer, from the specified file offset.
+ * Whole blocks are read from the device straight into the buffer, with a single
+ * request, and only a partial block at either end goes through a bounce block.
  * @param buffer The buffer to read the data into.
  * @param size The size of the buffer, and hence the number of bytes to read.
  * @param off The offset within the file.
@@ -90,121 +143,702 @@ namespace tarfs {
  */
 int TarFSFile::pread(void* buffer, size_t size, off_t off)
 {
-  if (off >= this->size()) return 0;
-	
-  // buffer is a pointer to the buffer that should receive the data.
-  // size is the amount of data to read from the file.
-  // off is the zero-based offset within the file to start reading from.
-
-  // If the size to read == 0 or file size == 0, then return 0
-  if (size == 0 || this->size() == 0) return 0;
-
-  // initialise the maximum number of bytes to read
-  unsigned int max_size = off + size;
-
-  // if the file size < num_size, then update max_size to file size
-  if (this->size() < max_size) {
-    max_size = this->size();
-  }
-
-  // find the block before the first block that contains the offset
-  unsigned int curr_block = (off - 1) / 512;
-
-  // start reading
-  int bytes_read = 0;
-  uint8_t *rbuffer = (uint8_t *) buffer; // must change name to avoid shadowing
-  // uint8_t *temp = new uint8_t[_owner.block_device().block_size()];
-  uint8_t temp[512];
-  
-  // reading one block per time
-  for (unsigned int i = curr_block; (i*512) < max_size; i++) {
-    _owner.block_device().read_blocks(temp, _file_start_block + i, 1);
-    unsigned int reader = i * 512;
-    // check if the index  within the range
-    for (int j = 0; j < 512; j++) {
-      if (reader + j >= off && reader + j < max_size) {
-	rbuffer[bytes_read] = temp[j];
-	bytes_read++;
-      }
+  unsigned int file_size = this->size();
+  if (off < 0 || (size_t) off >= file_size || size == 0) return 0;
+
+  // Never read past the end of the file.
+  if (size > (size_t) (file_size - off)) {
+    size = file_size - off;
+  }
+
+  uint8_t *out = (uint8_t *) buffer;
+  size_t remaining = size;
+
+  // The block that contains the offset, and how far into that block the offset is.
+  unsigned int block = off / TARFS_BLOCK_SIZE;
+  unsigned int head = off % TARFS_BLOCK_SIZE;
+
+  readahead(block, (off + size - 1) / TARFS_BLOCK_SIZE);
+
+  uint8_t bounce[TARFS_BLOCK_SIZE];
+
+  // If the read starts part-way into a block, or does not cover a whole block, then
+  // the first block is read into the bounce block, and the wanted part copied out.
+  if (head != 0 || remaining < TARFS_BLOCK_SIZE) {
+    if (!_owner.read_blocks(bounce, _file_start_block + block, 1)) return size - remaining;
+
+    size_t count = TARFS_BLOCK_SIZE - head;
+    if (count > remaining) {
+      count = remaining;
     }
+
+    memcpy(out, bounce + head, count);
+    out += count;
+    remaining -= count;
+    block++;
+  }
+
+  // Every whole block that is left is read directly into the caller's buffer.
+  size_t nr_blocks = remaining / TARFS_BLOCK_SIZE;
+  if (nr_blocks > 0) {
+    if (!_owner.read_blocks(out, _file_start_block + block, nr_blocks)) return size - remaining;
+
+    out += nr_blocks * TARFS_BLOCK_SIZE;
+    remaining -= nr_blocks * TARFS_BLOCK_SIZE;
+    block += nr_blocks;
+  }
+
+  // Finally, the start of the last block is copied out of the bounce block.
+  if (remaining > 0) {
+    if (!_owner.read_blocks(bounce, _file_start_block + block, 1)) return size - remaining;
+
+    memcpy(out, bounce, remaining);
+    remaining = 0;
   }
 
-  // find the block
   return size;
 }
 
+/**
+ * Reads blocks of this file into the block cache ahead of a read, if the file is
+ * being read sequentially.  Each time the reader reaches the end of what has been
+ * read ahead, the window doubles (up to a limit) and the next window is read along
+ * with the blocks the read needs, as one request.  Reading anywhere else starts the
+ * window again from the beginning.
+ *
+ * The block layer has no way to issue a request without waiting for it, so the
+ * readahead is done synchronously, as part of the read that triggers it.
+ * @param first The first block of the file that the read needs.
+ * @param last The last block of the file that the read needs.
+ */
+void TarFSFile::readahead(unsigned int first, unsigned int last)
+{
+  // A read is sequential if it starts where the last one left off, or in the block
+  // the last one finished part-way through.
+  bool sequential = first == _ra_next || first + 1 == _ra_next;
+  _ra_next = last + 1;
+
+  if (!sequential) {
+    _ra_end = 0;
+    _ra_window = 0;
+    return;
+  }
+
+  BlockCache *cache = _owner._cache;
+  if (!cache || tarfs_readahead == 0) return;
+
+  // Nothing to do until the reader needs a block that has not been read ahead.
+  if (last < _ra_end) return;
+
+  unsigned int max_window = (tarfs_readahead * 1024) / TARFS_BLOCK_SIZE;
+  if (max_window > cache->max_prefetch()) {
+    max_window = cache->max_prefetch();
+  }
+
+  _ra_window = _ra_window ? _ra_window * 2 : TARFS_RA_MIN_WINDOW;
+  if (_ra_window > max_window) {
+    _ra_window = max_window;
+  }
+
+  // A read that needs a whole window's worth of blocks by itself is left to go
+  // straight into the caller's buffer.
+  unsigned int start = _ra_end > first ? _ra_end : first;
+  if (last + 1 - start >= max_window) {
+    _ra_end = last + 1;
+    return;
+  }
+
+  unsigned int end = last + 1 + _ra_window;
+  if (end > start + max_window) {
+    end = start + max_window;
+  }
+
+  unsigned int nr_blocks = (size() + TARFS_BLOCK_SIZE - 1) / TARFS_BLOCK_SIZE;
+  if (end > nr_blocks) {
+    end = nr_blocks;
+  }
+
+  cache->prefetch(_file_start_block + start, end - start);
+  _ra_end = end;
+}
+
+/**
+ * Returns the length of a string in a fixed-size header field, which is only
+ * null-terminated if it is shorter than the field.
+ */
+static inline unsigned int field_length(const char *field, unsigned int size)
+{
+  unsigned int length = 0;
+  while (length < size && field[length] != 0) {
+    length++;
+  }
+
+  return length;
+}
+
+/**
+ * Walks a path through the tree from the given node, one component at a time,
+ * creating any node along the way that does not exist yet.  Components are
+ * looked up in place in the path, so nothing is allocated unless a node is created.
+ * @param node The node to start from.
+ * @param path The path, which need not be null-terminated.
+ * @param length The length of the path.
+ * @return Returns the node at the end of the path, or NULL if a node along it could
+ * not be created.
+ */
+TarFSNode *TarFS::walk_path(TarFSNode *node, const char *path, unsigned int length)
+{
+  unsigned int pos = 0;
+
+  while (pos < length) {
+    // Find the extent of the next component.
+    unsigned int start = pos;
+    while (pos < length && path[pos] != '/') {
+      pos++;
+    }
+
+    unsigned int component_length = pos - start;
+    const char *component = &path[start];
+    pos++;
+
+    // Skip empty components (from repeated or trailing slashes) and "."
+    if (component_length == 0 || (component_length == 1 && component[0] == '.')) continue;
+
+    TarFSNode *child = find_node(node, component, component_length, TarFSNode::hash_name(component, component_length));
+    if (!child) {
+      child = new_node(node, component, component_length);
+      if (!child) return NULL;
+    }
+
+    node = child;
+  }
+
+  return node;
+}
+
+/**
+ * Makes sure an array has room for at least the given number of elements, by
+ * doubling its capacity as many times as needed.
+ * @return Returns FALSE if there was no memory for the bigger array, in which case
+ * the array is left as it was.
+ */
+template<typename T>
+static bool grow(T *& array, unsigned int used, unsigned int& capacity, unsigned int needed)
+{
+  if (needed <= capacity) return true;
+
+  unsigned int new_capacity = capacity ? capacity : 64;
+  while (new_capacity < needed) {
+    new_capacity *= 2;
+  }
+
+  T *new_array = new T[new_capacity];
+  if (!new_array) return false;
+
+  if (array) {
+    memcpy(new_array, array, used * sizeof(T));
+    delete[] array;
+  }
+
+  array = new_array;
+  capacity = new_capacity;
+
+  return true;
+}
+
+/**
+ * Adds a member of the archive to the file-system.  Normally, its node (and the
+ * nodes of the directories above it) are created straight away.  When mounting
+ * lazily, the member is just recorded in the flat list of entries, with its path
+ * tidied up, for populate() to find later.
+ * @param root The root node.
+ * @param path The member's path, which need not be null-terminated.
+ * @param length The length of the path.
+ * @param type Whether the member is a file or a directory.
+ * @param data_block The block that the member's data starts at.
+ * @param size The size of the member's data, in bytes.
+ * @return Returns FALSE if there was no memory to add the member.
+ */
+bool TarFS::add_entry(TarFSNode *root, const char *path, unsigned int length, uint8_t type, unsigned int data_block, unsigned int size)
+{
+  if (!_lazy) {
+    TarFSNode *node = walk_path(root, path, length);
+    if (!node) return false;
+
+    if (node != root && type == TARFS_INDEX_FILE) {
+      node->set_file_data(data_block, size);
+    }
+
+    return true;
+  }
+
+  if (!grow(_entries, _nr_entries, _max_entries, _nr_entries + 1)) return false;
+  if (!grow(_names, _names_size, _max_names, _names_size + length)) return false;
+
+  // Copy the path, dropping empty and "." components, so that the path of every
+  // directory is a prefix of the paths below it.
+  unsigned int offset = _names_size, end = _names_size;
+  unsigned int pos = 0;
+
+  while (pos < length) {
+    unsigned int start = pos;
+    while (pos < length && path[pos] != '/') {
+      pos++;
+    }
+
+    unsigned int component_length = pos - start;
+    pos++;
+
+    if (component_length == 0 || (component_length == 1 && path[start] == '.')) continue;
+
+    if (end != offset) {
+      _names[end++] = '/';
+    }
+
+    memcpy(&_names[end], &path[start], component_length);
+    end += component_length;
+  }
+
+  // The root directory itself needs no entry.
+  if (end == offset) return true;
+
+  struct tarfs_index_entry& entry = _entries[_nr_entries++];
+  entry.data_block = data_block;
+  entry.size = size;
+  entry.name_offset = offset;
+  entry.name_length = end - offset;
+  entry.type = type;
+  entry.reserved = 0;
+
+  _names_size = end;
+  return true;
+}
+
+/**
+ * Creates the children of a directory that was mounted lazily, when it is first
+ * looked in, by scanning the flat list of entries for those directly below it.
+ * Directories found along the way are left to be populated when they are looked
+ * in themselves.  If there is no memory for a child, the directory is left as not
+ * populated, so that the next look in it tries again.
+ * @param dir The directory to populate.
+ */
+void TarFS::populate(TarFSNode& dir)
+{
+  UniqueLock<Mutex> l(_populate_lock);
+
+  // Another thread may have got here first.
+  if (dir.populated()) return;
+
+  const char *dir_path = &_names[dir.path_offset()];
+  unsigned int dir_path_length = dir.path_length();
+
+  for (unsigned int i = 0; i < _nr_entries; i++) {
+    const struct tarfs_index_entry& entry = _entries[i];
+    const char *path = &_names[entry.name_offset];
+
+    // Skip over the directory's own path, if the entry is below it at all.
+    unsigned int start = 0;
+    if (dir_path_length > 0) {
+      if (entry.name_length <= dir_path_length || path[dir_path_length] != '/' || memcmp(path, dir_path, dir_path_length) != 0) continue;
+      start = dir_path_length + 1;
+    }
+
+    // The next component is the child, which is the entry itself if it is the last.
+    unsigned int end = start;
+    while (end < entry.name_length && path[end] != '/') {
+      end++;
+    }
+
+    TarFSNode *child = find_node(&dir, &path[start], end - start, TarFSNode::hash_name(&path[start], end - start));
+    if (!child) {
+      child = new_node(&dir, &path[start], end - start);
+      if (!child) {
+        syslog.messagef(LogLevel::ERROR, "tarfs: out of memory populating directory");
+        return;
+      }
+
+      child->set_lazy_path(entry.name_offset, end);
+    }
+
+    if (end == entry.name_length && entry.type == TARFS_INDEX_FILE) {
+      child->set_file_data(entry.data_block, entry.size);
+    }
+  }
+
+  dir.set_populated();
+}
+
 /**
  * Reads all the file headers in the TAR file, and builds an in-memory
- * representation.
- * @return Returns the root TarFSNode that corresponds to the TAR file structure.
+ * representation.  The archive is read in chunks of several blocks at a time,
+ * and the headers are parsed in place in the chunk.  Members whose data runs
+ * past the end of the chunk are skipped over without reading their data.
+ * @return Returns the root TarFSNode that corresponds to the TAR file structure, or
+ * NULL if there was no memory to scan it.
  */
 TarFSNode* TarFS::build_tree()
 {
+  Nanoseconds start_time = sys.runtime();
+
   // Create the root node.
-  TarFSNode *root = new TarFSNode(NULL, "", *this);
+  TarFSNode *root = new_root();
+  if (!root) return NULL;
 
-  // Initialise reading mechanism
-  struct posix_header *header = (struct posix_header *) new char[block_device().block_size()]; // header will either be at header or zero block
-  uint8_t *data_block = new uint8_t[block_device().block_size()];
   size_t nr_blocks = block_device().block_count();
-  syslog.messagef(LogLevel::DEBUG, "Block Device nr-blocks=%lu", nr_blocks);
-  TarFSNode *parent;
-  unsigned int curr_block = 0;
-
-  while (curr_block < nr_blocks) {
-    // read and check if this is the end of a file
-    block_device().read_blocks(header, curr_block, 1);
-    block_device().read_blocks(data_block, curr_block + 1, 1);
-    if (is_zero_block((uint8_t*) header) && is_zero_block(data_block)) {
-      return root;
+  uint8_t *chunk = new uint8_t[TARFS_SCAN_CHUNK * TARFS_BLOCK_SIZE];
+  if (!chunk) {
+    syslog.messagef(LogLevel::ERROR, "tarfs: out of memory for the scan buffer");
+    return NULL;
+  }
+
+  size_t chunk_start = 0, chunk_end = 0;
+
+  unsigned int nr_entries = 0, nr_reads = 0;
+  size_t block = 0;
+
+  while (block < nr_blocks) {
+    // Make sure the header is in the chunk, along with the block after it, which
+    // is needed to spot the end of the archive.  The scan reads the device
+    // directly, rather than through the cache, as nothing it reads is needed again.
+    if (block < chunk_start || block >= chunk_end || (block + 1 == chunk_end && chunk_end < nr_blocks)) {
+      size_t count = nr_blocks - block;
+      if (count > TARFS_SCAN_CHUNK) {
+        count = TARFS_SCAN_CHUNK;
+      }
+
+      if (!block_device().read_blocks(chunk, block, count)) {
+        syslog.messagef(LogLevel::ERROR, "tarfs: unable to read block %lu", block);
+        break;
+      }
+
+      chunk_start = block;
+      chunk_end = block + count;
+      nr_reads++;
     }
 
-    // checking the file size to initialise the number of blocks
-    unsigned int size = octal2ui(header->size);
-    if (size % 512 == 0) {
-      size = size/512;
-    } else {
-      size = size/512 + 1;
+    const uint8_t *header_block = &chunk[(block - chunk_start) * TARFS_BLOCK_SIZE];
+
+    // The archive ends with two zero blocks (or at the end of the device).  A lone
+    // zero block is skipped.
+    if (is_zero_block(header_block)) {
+      if (block + 1 >= nr_blocks || is_zero_block(header_block + TARFS_BLOCK_SIZE)) break;
+
+      block++;
+      continue;
     }
 
-    // getting path to file
-    parent = root;
-    String path_to_file = String(header->name);
-    List<String> path_list = path_to_file.split('/', true);
-
-    // iterating through all files/directories and check if file exists as as child
-    int elem = 0;
-    int path_count = path_list.count();
-    while (elem < path_count) {
-      if (!parent->get_child(path_list.at(elem))) {
-	TarFSNode *child = new TarFSNode(parent, path_list.at(elem), *this);
-	parent->add_child(path_list.at(elem), child);
-
-	// check if element is a file, not a direcotry
-	if (elem == path_count - 1) {
-	  child->set_block_offset(curr_block);
-	  child->size(octal2ui(header->size));
-	}
-
-	elem++;
-      } else {
-	// assign the parent ot the child
-	parent = (TarFSNode*) (parent->get_child(path_list.at(elem)));
-	elem++;
+    const struct posix_header *header = (const struct posix_header *) header_block;
+    unsigned int size = octal2ui(header->size);
+
+    // Extended headers describe the member after them, rather than being members
+    // themselves.
+    if (header->typeflag != 'x' && header->typeflag != 'g') {
+      // A name too long for the name field is split, with the start of it in the
+      // prefix field.
+      char path[TARFS_MAX_PATH];
+      unsigned int length = field_length(header->prefix, sizeof(header->prefix));
+      memcpy(path, header->prefix, length);
+      if (length > 0) {
+        path[length++] = '/';
+      }
+
+      unsigned int name_length = field_length(header->name, sizeof(header->name));
+      memcpy(&path[length], header->name, name_length);
+      length += name_length;
+
+      if (!add_entry(root, path, length, header->typeflag == '5' ? TARFS_INDEX_DIRECTORY : TARFS_INDEX_FILE, block + 1, size)) {
+        syslog.messagef(LogLevel::ERROR, "tarfs: out of memory after %u entries", nr_entries);
+        break;
       }
+
+      nr_entries++;
     }
 
-    curr_block = curr_block + size + 1;    
+    block += 1 + (size + TARFS_BLOCK_SIZE - 1) / TARFS_BLOCK_SIZE;
+  }
+
+  delete[] chunk;
+
+  syslog.messagef(LogLevel::INFO, "tarfs: mounted %u entries in %lu us, with %u reads",
+    nr_entries, (sys.runtime() - start_time).count() / 1000, nr_reads);
+
+  return root;
+}
+
+/**
+ * Builds the in-memory representation of the TAR file from the index appended to
+ * it, which only needs the index to be read, however big the archive is.
+ * @return Returns the root TarFSNode, or NULL if there is no index, or it does not
+ * match the archive, in which case the archive must be scanned instead.
+ */
+TarFSNode* TarFS::load_index()
+{
+  Nanoseconds start_time = sys.runtime();
+
+  size_t nr_blocks = block_device().block_count();
+  if (nr_blocks < 2) return NULL;
+
+  uint8_t trailer_block[TARFS_BLOCK_SIZE];
+  if (!block_device().read_blocks(trailer_block, nr_blocks - 1, 1)) return NULL;
+
+  const struct tarfs_index_trailer *trailer = (const struct tarfs_index_trailer *) trailer_block;
+  if (strncmp(trailer->magic, TARFS_INDEX_MAGIC, TARFS_INDEX_MAGIC_SIZE) != 0) return NULL;
+
+  // The table must sit between the end of the archive and the trailer, and be big
+  // enough for its entries.
+  size_t table_blocks = (trailer->table_size + TARFS_BLOCK_SIZE - 1) / TARFS_BLOCK_SIZE;
+  if (trailer->table_block < trailer->archive_blocks
+      || trailer->table_block + table_blocks >= nr_blocks
+      || trailer->table_size < trailer->nr_entries * sizeof(struct tarfs_index_entry)) {
+    syslog.messagef(LogLevel::WARNING, "tarfs: ignoring malformed index");
+    return NULL;
+  }
+
+  uint8_t *table = new uint8_t[table_blocks * TARFS_BLOCK_SIZE];
+  if (!table) return NULL;
+
+  if (!block_device().read_blocks(table, trailer->table_block, table_blocks)) {
+    delete[] table;
+    return NULL;
+  }
+
+  if (tarfs_index_checksum(table, trailer->table_size) != trailer->checksum) {
+    syslog.messagef(LogLevel::WARNING, "tarfs: ignoring index with bad checksum");
+    delete[] table;
+    return NULL;
+  }
+
+  const struct tarfs_index_entry *entries = (const struct tarfs_index_entry *) table;
+  const char *names = (const char *) &entries[trailer->nr_entries];
+  uint32_t names_size = trailer->table_size - (trailer->nr_entries * sizeof(struct tarfs_index_entry));
+
+  TarFSNode *root = new_root();
+  if (!root) {
+    delete[] table;
+    return NULL;
   }
+
+  for (unsigned int i = 0; i < trailer->nr_entries; i++) {
+    const struct tarfs_index_entry *entry = &entries[i];
+
+    // The checksum only guards against corruption, so still make sure the entry
+    // stays within the table and the archive.
+    if (entry->name_offset > names_size || entry->name_length > names_size - entry->name_offset) continue;
+
+    if (entry->type == TARFS_INDEX_FILE && entry->data_block + ((entry->size + TARFS_BLOCK_SIZE - 1) / TARFS_BLOCK_SIZE) > trailer->archive_blocks) continue;
+
+    if (!add_entry(root, &names[entry->name_offset], entry->name_length, entry->type, entry->data_block, entry->size)) {
+      syslog.messagef(LogLevel::ERROR, "tarfs: out of memory after %u entries", i);
+      break;
+    }
+  }
+
+  syslog.messagef(LogLevel::INFO, "tarfs: mounted %u entries from index in %lu us",
+    trailer->nr_entries, (sys.runtime() - start_time).count() / 1000);
+
+  delete[] table;
   return root;
 }
 
 /**
- * Returns the size of this TarFS File
+ * Creates the root node, which must be populated before it is looked in if the
+ * file-system is being mounted lazily.
+ */
+TarFSNode* TarFS::new_root()
+{
+  TarFSNode *root = new_node(NULL, "", 0);
+  if (root && _lazy) {
+    root->set_lazy_path(0, 0);
+  }
+
+  return root;
+}
+
+/**
+ * Creates a node in the arena, and links it into its parent's children and the
+ * node table.
+ * @param parent The parent node, or NULL for the root.
+ * @param name The node's name, which need not be null-terminated.
+ * @param length The length of the name.
+ * @return Returns the new node, or NULL if there was no memory for it.
+ */
+TarFSNode* TarFS::new_node(TarFSNode *parent, const char *name, unsigned int length)
+{
+  // If the node table cannot grow, its chains just get longer, as long as there is a
+  // table at all.
+  if (_nr_nodes >= _node_table_size && !grow_node_table() && _node_table_size == 0) return NULL;
+
+  TarFSNode::hash_type hash = TarFSNode::hash_name(name, length);
+
+  const char *interned = intern(name, length, hash);
+  if (!interned) return NULL;
+
+  TarFSNode *node = new (_arena) TarFSNode(parent, interned, length, hash, *this);
+  if (!node) return NULL;
+
+  if (parent) {
+    node->_next_sibling = parent->_first_child;
+    parent->_first_child = node;
+  }
+
+  unsigned int bucket = node_bucket(parent, hash);
+  node->_hash_next = _node_table[bucket];
+  _node_table[bucket] = node;
+  _nr_nodes++;
+
+  return node;
+}
+
+/**
+ * Finds a node from its parent and its name.  When mounted lazily, populating a
+ * directory can grow (and so replace) the node table at any time, so the lookup is
+ * made under the populate lock.
+ * @return Returns the node, or NULL if there is no such node.
+ */
+TarFSNode* TarFS::lookup(const TarFSNode *parent, const char *name, unsigned int length, uint64_t hash) const
+{
+  if (!_lazy) return find_node(parent, name, length, hash);
+
+  UniqueLock<Mutex> l(_populate_lock);
+  return find_node(parent, name, length, hash);
+}
+
+/**
+ * Finds a node from its parent and its name, without taking any lock.  This is for
+ * use while building the tree, either at mount or with the populate lock held.
+ * @return Returns the node, or NULL if there is no such node.
+ */
+TarFSNode* TarFS::find_node(const TarFSNode *parent, const char *name, unsigned int length, uint64_t hash) const
+{
+  if (_node_table_size == 0) return NULL;
+
+  for (TarFSNode *node = _node_table[node_bucket(parent, hash)]; node; node = node->_hash_next) {
+    if (node->_parent == parent && node->_hash == hash && node->_name_length == length && memcmp(node->_name, name, length) == 0) {
+      return node;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Returns the shared, null-terminated copy of a name, making it if need be.  Archives
+ * repeat the same few names (e.g. "bin", "lib" and "Makefile") many times over, so
+ * each is only stored once.
+ * @return Returns the interned name, or NULL if there was no memory for it.
+ */
+const char* TarFS::intern(const char *name, unsigned int length, uint64_t hash)
+{
+  if (_name_table_size > 0) {
+    for (InternedName *interned = _name_table[hash & (_name_table_size - 1)]; interned; interned = interned->next) {
+      if (interned->hash == hash && interned->length == length && memcmp(interned->name, name, length) == 0) {
+        return interned->name;
+      }
+    }
+  }
+
+  if (_nr_names >= _name_table_size && !grow_name_table() && _name_table_size == 0) return NULL;
+
+  InternedName *interned = (InternedName *) _arena.alloc(sizeof(InternedName) + length);
+  if (!interned) return NULL;
+
+  interned->hash = hash;
+  interned->length = length;
+  memcpy(interned->name, name, length);
+  interned->name[length] = 0;
+
+  InternedName **bucket = &_name_table[hash & (_name_table_size - 1)];
+  interned->next = *bucket;
+  *bucket = interned;
+  _nr_names++;
+
+  return interned->name;
+}
+
+/**
+ * Doubles the number of buckets in the node table, and redistributes the nodes.
+ * @return Returns FALSE if there was no memory for the new table, in which case the
+ * old one is kept.
+ */
+bool TarFS::grow_node_table()
+{
+  TarFSNode **old_table = _node_table;
+  unsigned int old_size = _node_table_size;
+  unsigned int new_size = old_size ? old_size * 2 : TARFS_MIN_BUCKETS;
+
+  TarFSNode **new_table = new TarFSNode *[new_size];
+  if (!new_table) return false;
+
+  for (unsigned int i = 0; i < new_size; i++) {
+    new_table[i] = NULL;
+  }
+
+  _node_table = new_table;
+  _node_table_size = new_size;
+
+  for (unsigned int i = 0; i < old_size; i++) {
+    TarFSNode *node = old_table[i];
+    while (node) {
+      TarFSNode *next = node->_hash_next;
+
+      unsigned int bucket = node_bucket(node->_parent, node->_hash);
+      node->_hash_next = _node_table[bucket];
+      _node_table[bucket] = node;
+
+      node = next;
+    }
+  }
+
+  delete[] old_table;
+  return true;
+}
+
+/**
+ * Doubles the number of buckets in the name table, and redistributes the names.
+ * @return Returns FALSE if there was no memory for the new table, in which case the
+ * old one is kept.
  */
-unsigned int TarFSFile::size() const
+bool TarFS::grow_name_table()
 {
-  return octal2ui(_hdr->size);
+  InternedName **old_table = _name_table;
+  unsigned int old_size = _name_table_size;
+  unsigned int new_size = old_size ? old_size * 2 : TARFS_MIN_BUCKETS;
+
+  InternedName **new_table = new InternedName *[new_size];
+  if (!new_table) return false;
+
+  for (unsigned int i = 0; i < new_size; i++) {
+    new_table[i] = NULL;
+  }
+
+  _name_table = new_table;
+  _name_table_size = new_size;
+
+  for (unsigned int i = 0; i < old_size; i++) {
+    InternedName *interned = old_table[i];
+    while (interned) {
+      InternedName *next = interned->next;
+
+      InternedName **bucket = &_name_table[interned->hash & (_name_table_size - 1)];
+      interned->next = *bucket;
+      *bucket = interned;
+
+      interned = next;
+    }
+  }
+
+  delete[] old_table;
+  return true;
+}
+
+/**
+ * Reads blocks from the underlying block device, through the block cache if there
+ * is one.
+ */
+bool TarFS::read_blocks(void *buffer, size_t offset, size_t count)
+{
+  if (_cache) return _cache->read_blocks(buffer, offset, count);
+  return block_device().read_blocks(buffer, offset, count);
 }
 
 /* --- YOU DO NOT NEED TO CHANGE ANYTHING BELOW THIS LINE --- */
@@ -217,7 +851,27 @@ PFSNode *TarFS::mount()
 {
   // If the root node has not been generated, then build it.
   if (_root_node == NULL) {
-    _root_node = build_tree();
+    _lazy = tarfs_lazy;
+
+    if (tarfs_cache_size > 0) {
+      _cache = new BlockCache(block_device(), (tarfs_cache_size * 1024) / block_device().block_size());
+    }
+
+    // Use the archive's index if it has one, and scan the archive otherwise.
+    if (tarfs_use_index) {
+      _root_node = load_index();
+    }
+
+    if (_root_node == NULL) {
+      _root_node = build_tree();
+    }
+
+    size_t metadata_size = _arena.used()
+      + (_node_table_size * sizeof(TarFSNode *)) + (_name_table_size * sizeof(InternedName *))
+      + (_max_entries * sizeof(struct tarfs_index_entry)) + _max_names;
+
+    syslog.messagef(LogLevel::DEBUG, "tarfs: %u nodes, %u names, %u lazy entries, %lu bytes of metadata",
+      _nr_nodes, _nr_names, _nr_entries, metadata_size);
   }
 
   // Return the root node.
@@ -225,28 +879,60 @@ PFSNode *TarFS::mount()
 }
 
 /**
- * Constructs a TarFS File object, given the owning file system and the block
+ * Releases everything that was built when the file-system was mounted.  The nodes
+ * all live in the arena, so they go at once, without being destroyed one by one.
+ * Any node that is still referenced is no longer valid.
  */
-TarFSFile::TarFSFile(TarFS& owner, unsigned int file_header_block)
-  : _hdr(NULL),
-    _owner(owner),
-    _file_start_block(file_header_block),
-    _cur_pos(0)
+void TarFS::unmount()
+{
+  _root_node = NULL;
+  _arena.release();
+
+  delete[] _node_table;
+  _node_table = NULL;
+  _node_table_size = 0;
+  _nr_nodes = 0;
+
+  delete[] _name_table;
+  _name_table = NULL;
+  _name_table_size = 0;
+  _nr_names = 0;
+
+  delete[] _entries;
+  _entries = NULL;
+  _nr_entries = _max_entries = 0;
+
+  delete[] _names;
+  _names = NULL;
+  _names_size = _max_names = 0;
+
+  delete _cache;
+  _cache = NULL;
+}
+
+TarFS::~TarFS()
+{
+  unmount();
+}
+
+/**
+ * Constructs a TarFS File object, given the owning file system, the block that the
+ * file's data starts at, and the size of the file.  Everything needed is already
+ * known from when the tree was built, so the device is not touched.
+ */
+TarFSFile::TarFSFile(TarFS& owner, unsigned int file_data_block, unsigned int file_size)
+  : _owner(owner),
+    _file_start_block(file_data_block),
+    _size(file_size),
+    _cur_pos(0),
+    _ra_next(0),
+    _ra_end(0),
+    _ra_window(0)
 {
-  // Allocate storage for the header.
-  _hdr = (struct posix_header *) new char[_owner.block_device().block_size()];
-	
-  // Read the header block into the header structure.
-  _owner.block_device().read_blocks(_hdr, _file_start_block, 1);
-	
-  // Increment the starting block for file data.
-  _file_start_block++;
 }
 
 TarFSFile::~TarFSFile()
 {
-  // Delete the header structure that was allocated in the constructor.
-  delete _hdr;
 }
 
 /**
@@ -254,7 +940,8 @@ TarFSFile::~TarFSFile()
  */
 void TarFSFile::close()
 {
-  // Nothing to release.
+  // Nothing to release, but this is a good time to report how the cache is doing.
+  if (_owner._cache) _owner._cache->dump_stats();
 }
 
 /**
@@ -305,7 +992,21 @@ void TarFSFile::seek(off_t offset, SeekType type)
   }
 }
 
-TarFSNode::TarFSNode(TarFSNode *parent, const String& name, TarFS& owner) : PFSNode(parent, owner), _name(name), _size(0), _has_block_offset(false), _block_offset(0)
+TarFSNode::TarFSNode(TarFSNode *parent, const char *name, unsigned int name_length, hash_type hash, TarFS& owner)
+  : PFSNode(parent, owner),
+    _parent(parent),
+    _first_child(NULL),
+    _next_sibling(NULL),
+    _hash_next(NULL),
+    _name(name),
+    _hash(hash),
+    _data_block(0),
+    _size(0),
+    _path_offset(0),
+    _name_length(name_length),
+    _path_length(0),
+    _is_file(false),
+    _populated(true)
 {
 }
 
@@ -319,13 +1020,13 @@ TarFSNode::~TarFSNode()
  */
 File* TarFSNode::open()
 {
-  // This is only a file if it has been associated with a block offset.
-  if (!_has_block_offset) {
+  // This is only a file if it has been associated with its data.
+  if (!_is_file) {
     return NULL;
   }
 
-  // Create a new file object, with a header from this node's block offset.
-  return new TarFSFile((TarFS&) owner(), _block_offset);
+  // Create a new file object over this node's data.
+  return new TarFSFile((TarFS&) owner(), _data_block, _size);
 }
 
 /**
@@ -334,6 +1035,10 @@ File* TarFSNode::open()
  */
 Directory* TarFSNode::opendir()
 {
+  if (!populated()) {
+    ((TarFS&) owner()).populate(*this);
+  }
+
   return new TarFSDirectory(*this);
 }
 
@@ -344,15 +1049,23 @@ Directory* TarFSNode::opendir()
  */
 PFSNode* TarFSNode::get_child(const String& name)
 {
-  TarFSNode *child;
-
-  // Try to find the given child node in the children map, and return
-  // NULL if it wasn't found.
-  if (!_children.try_get_value(name.get_hash(), child)) {
-    return NULL;
+  if (!populated()) {
+    ((TarFS&) owner()).populate(*this);
   }
 
-  return child;
+  const char *str = name.c_str();
+  return find_child(str, strlen(str));
+}
+
+/**
+ * Attempts to retrieve a child node, given its name and the name's length.
+ * @param name
+ * @param length
+ * @return 
+ */
+TarFSNode* TarFSNode::find_child(const char *name, unsigned int length) const
+{
+  return ((TarFS&) owner()).lookup(this, name, length, hash_name(name, length));
 }
 
 /**
@@ -368,42 +1081,50 @@ PFSNode* TarFSNode::mkdir(const String& name)
 }
 
 /**
- * A helper routine that updates this node with the offset of the block
- * that contains the header of the file that this node represents.
- * @param offset The block offset that corresponds to this node.
+ * A helper routine that marks this node as a file, and records where the
+ * file's data is and how big it is, so that the file can be opened without
+ * reading its header again.
+ * @param data_block The block that the file's data starts at.
+ * @param size The size of the file, in bytes.
  */
-void TarFSNode::set_block_offset(unsigned int offset)
+void TarFSNode::set_file_data(unsigned int data_block, unsigned int size)
 {
-  _has_block_offset = true;
-  _block_offset = offset;
+  _is_file = true;
+  _data_block = data_block;
+  _size = size;
 }
 
 /**
- * A helper routine that adds a child node to the internal children
- * map of this node.
- * @param name The name of the child node.
- * @param child The actual child node.
+ * A helper routine that marks this node as belonging to a lazily mounted
+ * file-system, so that its children are created when it is first looked in.
+ * @param path_offset Where this node's path is in the file-system's names.
+ * @param path_length The length of this node's path.
  */
-void TarFSNode::add_child(const String& name, TarFSNode *child)
+void TarFSNode::set_lazy_path(unsigned int path_offset, unsigned int path_length)
 {
-  _children.add(name.get_hash(), child);
+  _populated = false;
+  _path_offset = path_offset;
+  _path_length = path_length;
 }
 
 TarFSDirectory::TarFSDirectory(TarFSNode& node) : _entries(NULL), _nr_entries(0), _cur_entry(0)
 {
-  _nr_entries = node.children().count();
+  for (TarFSNode *child = node.first_child(); child; child = child->next_sibling()) {
+    _nr_entries++;
+  }
+
   _entries = new DirectoryEntry[_nr_entries];
 
   int i = 0;
-  for (const auto& child : node.children()) {
-    _entries[i].name = child.value->name();
-    _entries[i++].size = child.value->size();
+  for (TarFSNode *child = node.first_child(); child; child = child->next_sibling()) {
+    _entries[i].name = child->name();
+    _entries[i++].size = child->size();
   }
 }
 
 TarFSDirectory::~TarFSDirectory()
 {
-  delete _entries;
+  delete[] _entries;
 }
 
 bool TarFSDirectory::read_entry(infos::fs::DirectoryEntry& entry)
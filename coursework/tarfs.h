@@ -17,8 +17,28 @@
 #include <infos/drivers/block/block-device.h>
 
 #include <infos/util/string.h>
-#include <infos/util/map.h>
-#include <infos/util/list.h>
+
+#include "tarfs-arena.h"
+#include "tarfs-cache.h"
+#include "tarfs-index.h"
+
+// The size of a block in a TAR file.
+#define TARFS_BLOCK_SIZE	512
+
+// The number of blocks read at once while scanning the archive at mount time.
+#define TARFS_SCAN_CHUNK	64
+
+// The longest path a member can have, made of the prefix and name fields of a TAR
+// header, joined by a slash.
+#define TARFS_MAX_PATH		(155 + 1 + 100)
+
+// The number of buckets the node and name hash tables start with.  Each table doubles
+// in size whenever it has more entries than buckets.
+#define TARFS_MIN_BUCKETS	256
+
+// The readahead window (in blocks) that a file starts with once it is seen to be read
+// sequentially.  The window doubles each time it is used up.
+#define TARFS_RA_MIN_WINDOW	8
 
 namespace tarfs {
 
@@ -33,10 +53,17 @@ namespace tarfs {
 
 	public:
 
-		TarFS(infos::drivers::block::BlockDevice& bdev) : BlockBasedFilesystem(bdev), _root_node(NULL) {
+		TarFS(infos::drivers::block::BlockDevice& bdev)
+			: BlockBasedFilesystem(bdev), _root_node(NULL), _cache(NULL),
+			  _node_table(NULL), _node_table_size(0), _nr_nodes(0),
+			  _name_table(NULL), _name_table_size(0), _nr_names(0), _lazy(false),
+			  _entries(NULL), _nr_entries(0), _max_entries(0), _names(NULL), _names_size(0), _max_names(0) {
 		}
 
+		~TarFS();
+
 		infos::fs::PFSNode *mount() override;
+		void unmount();
 
 		const infos::util::String name() const {
 			return "tarfs";
@@ -44,8 +71,32 @@ namespace tarfs {
 
 	private:
 		TarFSNode *build_tree();
+		TarFSNode *load_index();
+		TarFSNode *walk_path(TarFSNode *node, const char *path, unsigned int length);
+		TarFSNode *new_root();
+
+		TarFSNode *new_node(TarFSNode *parent, const char *name, unsigned int length);
+		TarFSNode *lookup(const TarFSNode *parent, const char *name, unsigned int length, uint64_t hash) const;
+		TarFSNode *find_node(const TarFSNode *parent, const char *name, unsigned int length, uint64_t hash) const;
+		const char *intern(const char *name, unsigned int length, uint64_t hash);
+
+		bool grow_node_table();
+		bool grow_name_table();
+
+		unsigned int node_bucket(const TarFSNode *parent, uint64_t hash) const
+		{
+			// Mix the parent into the name's hash, so that the same name in different
+			// directories lands in different buckets.
+			uint64_t key = hash ^ ((uintptr_t) parent * 0x9e3779b97f4a7c15ULL);
+			return (key ^ (key >> 32)) & (_node_table_size - 1);
+		}
+
+		bool add_entry(TarFSNode *root, const char *path, unsigned int length, uint8_t type, unsigned int data_block, unsigned int size);
+		void populate(TarFSNode& dir);
+
+		bool read_blocks(void *buffer, size_t offset, size_t count);
 		
-		static bool is_zero_block(const uint8_t *buffer, size_t size = 512) {
+		static bool is_zero_block(const uint8_t *buffer, size_t size = TARFS_BLOCK_SIZE) {
 			for (unsigned int i = 0; i < size; i++) {
 				if (buffer[i] != 0) return false;
 			}
@@ -53,13 +104,46 @@ namespace tarfs {
 			return true;
 		}
 
+		/**
+		 * A name, interned so that every node with the same name shares one copy.
+		 */
+		struct InternedName {
+			InternedName *next;
+			uint64_t hash;
+			unsigned int length;
+			char name[1];
+		};
+
 		TarFSNode *_root_node;
+		BlockCache *_cache;
+
+		// The arena that the nodes and their names are allocated from.
+		Arena _arena;
+
+		// The hash table that finds a node from its parent and name.
+		TarFSNode **_node_table;
+		unsigned int _node_table_size, _nr_nodes;
+
+		// The hash table of interned names.
+		InternedName **_name_table;
+		unsigned int _name_table_size, _nr_names;
+
+		// When mounted lazily, the flat list of entries that directories are
+		// populated from, and the (tidied up) paths that the entries refer to.  The
+		// lock serialises populating directories, and lookups in the node table,
+		// which populating may grow.
+		bool _lazy;
+		struct tarfs_index_entry *_entries;
+		unsigned int _nr_entries, _max_entries;
+		char *_names;
+		unsigned int _names_size, _max_names;
+		mutable infos::util::Mutex _populate_lock;
 	};
 
 	class TarFSFile : public infos::fs::File {
 	public:
 
-		TarFSFile(TarFS& owner, unsigned int file_header_block);
+		TarFSFile(TarFS& owner, unsigned int file_data_block, unsigned int file_size);
 		virtual ~TarFSFile();
 
 		void close() override;
@@ -74,13 +158,20 @@ namespace tarfs {
 
 		void seek(off_t offset, SeekType type) override;
 		
-		unsigned int size() const;
+		unsigned int size() const {
+			return _size;
+		}
 
 	private:
-		struct posix_header *_hdr;
+		void readahead(unsigned int first, unsigned int last);
 
 		TarFS& _owner;
-		unsigned int _file_start_block, _cur_pos;
+		unsigned int _file_start_block, _size, _cur_pos;
+
+		// The readahead state: the block a sequential read would start from next,
+		// the block up to which the file has been read ahead, and the window size.
+		// All are in blocks, relative to the start of the file.
+		unsigned int _ra_next, _ra_end, _ra_window;
 	};
 
 	class TarFSDirectory : public infos::fs::Directory {
@@ -97,12 +188,21 @@ namespace tarfs {
 	};
 
 	class TarFSNode : public infos::fs::PFSNode {
+		friend class TarFS;
+
 	public:
-		typedef infos::util::Map<infos::util::String::hash_type, TarFSNode *> TarFSNodeMap;
+		typedef uint64_t hash_type;
 
-		TarFSNode(TarFSNode *parent, const infos::util::String& name, TarFS& owner);
+		TarFSNode(TarFSNode *parent, const char *name, unsigned int name_length, hash_type hash, TarFS& owner);
 		virtual ~TarFSNode();
 
+		/**
+		 * Nodes are allocated from their file-system's arena, and freed all at once
+		 * when it is unmounted, rather than one by one.
+		 */
+		static void *operator new(size_t size, Arena& arena) noexcept { return arena.alloc(size); }
+		static void operator delete(void *ptr) { }
+
 		infos::fs::File* open() override;
 		infos::fs::Directory* opendir() override;
 
@@ -110,15 +210,43 @@ namespace tarfs {
 
 		PFSNode* mkdir(const infos::util::String& name) override;
 
-		void set_block_offset(unsigned int offset);
+		void set_file_data(unsigned int data_block, unsigned int size);
+		void set_lazy_path(unsigned int path_offset, unsigned int path_length);
+
+		// A directory's children are all in place before it is marked as populated, so
+		// a thread that sees it populated must also see them.
+		bool populated() const { return __atomic_load_n(&_populated, __ATOMIC_ACQUIRE); }
+		void set_populated() { __atomic_store_n(&_populated, true, __ATOMIC_RELEASE); }
+
+		unsigned int path_offset() const { return _path_offset; }
+		unsigned int path_length() const { return _path_length; }
+
+		TarFSNode *find_child(const char *name, unsigned int length) const;
+
+		/**
+		 * Hashes a name with 64-bit FNV-1a.  The name is given by its length, so that a
+		 * component can be hashed in place in a path.
+		 */
+		static hash_type hash_name(const char *name, unsigned int length)
+		{
+			hash_type hash = 0xcbf29ce484222325ULL;
+			for (unsigned int i = 0; i < length; i++) {
+				hash ^= (uint8_t) name[i];
+				hash *= 0x100000001b3ULL;
+			}
 
-		void add_child(const infos::util::String& name, TarFSNode *child);
+			return hash;
+		}
+
+		TarFSNode *first_child() const {
+			return _first_child;
+		}
 
-		const TarFSNodeMap& children() const {
-			return _children;
+		TarFSNode *next_sibling() const {
+			return _next_sibling;
 		}
 
-		const infos::util::String& name() const {
+		const char *name() const {
 			return _name;
 		}
 
@@ -126,16 +254,25 @@ namespace tarfs {
 			return _size;
 		}
 
-		void size(unsigned int size) {
-			_size = size;
-		}
-
 	private:
-		TarFSNodeMap _children;
-		const infos::util::String _name;
-		unsigned int _size;
-		bool _has_block_offset;
-		unsigned int _block_offset;
+		// The tree, threaded through the nodes themselves.
+		TarFSNode *_parent, *_first_child, *_next_sibling;
+
+		// The next node in the same bucket of the file-system's node table.
+		TarFSNode *_hash_next;
+
+		// The interned name, and its hash.
+		const char *_name;
+		hash_type _hash;
+
+		unsigned int _data_block, _size;
+
+		// Where the node's path is in the file-system's names, if its children
+		// have not been created yet.
+		unsigned int _path_offset;
+
+		uint16_t _name_length, _path_length;
+		bool _is_file, _populated;
 	};
 }
 
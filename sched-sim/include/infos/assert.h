@@ -0,0 +1,10 @@
+/*
+ * Host stand-in for <infos/assert.h>
+ */
+#ifndef SIM_INFOS_ASSERT_H
+#define SIM_INFOS_ASSERT_H
+
+#include <infos/define.h>
+#include <cassert>
+
+#endif
@@ -0,0 +1,15 @@
+/*
+ * Host stand-in for <infos/define.h>
+ */
+#ifndef SIM_INFOS_DEFINE_H
+#define SIM_INFOS_DEFINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define __packed		__attribute__((packed))
+#define __noreturn		__attribute__((noreturn))
+#define __aligned(x)		__attribute__((aligned(x)))
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof(a[0]))
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * Host stand-in for <infos/drivers/timer/lapic-timer.h>
+ */
+#ifndef SIM_INFOS_DRIVERS_TIMER_LAPIC_TIMER_H
+#define SIM_INFOS_DRIVERS_TIMER_LAPIC_TIMER_H
+
+#include <infos/drivers/timer/timer.h>
+
+namespace infos {
+	namespace drivers {
+		namespace timer {
+			/**
+			 * The simulated CPU's timer.  The simulator reads back the programmed
+			 * expiry to decide when the next timer interrupt happens.
+			 */
+			class LAPICTimer : public Timer {
+			public:
+				static const DeviceClass LAPICTimerDeviceClass;
+
+				LAPICTimer(uint64_t frequency)
+					: Timer(frequency), _periodic(true), _running(false), _period(0), _start(0) { }
+
+				const DeviceClass& device_class() const override { return LAPICTimerDeviceClass; }
+
+				void init_oneshot(uint64_t period) override { _periodic = false; _period = period; }
+				void init_periodic(uint64_t period) override { _periodic = true; _period = period; }
+
+				void start() override;
+				void stop() override { _running = false; }
+				void reset() override { start(); }
+
+				bool running() const { return _running; }
+				bool periodic() const { return _periodic; }
+
+				/**
+				 * Returns the time (in nanoseconds) at which the timer next expires.
+				 */
+				uint64_t expiry() const;
+
+				/**
+				 * Called by the simulator when the timer expires.
+				 */
+				void expired();
+
+			private:
+				bool _periodic, _running;
+				uint64_t _period, _start;
+			};
+		}
+	}
+}
+
+#endif
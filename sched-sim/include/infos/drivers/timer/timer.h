@@ -0,0 +1,34 @@
+/*
+ * Host stand-in for <infos/drivers/timer/timer.h>
+ */
+#ifndef SIM_INFOS_DRIVERS_TIMER_TIMER_H
+#define SIM_INFOS_DRIVERS_TIMER_TIMER_H
+
+#include <infos/drivers/device.h>
+
+namespace infos {
+	namespace drivers {
+		namespace timer {
+			class Timer : public Device {
+			public:
+				static const DeviceClass TimerDeviceClass;
+
+				Timer(uint64_t frequency) : _frequency(frequency) { }
+
+				virtual void init_oneshot(uint64_t period) = 0;
+				virtual void init_periodic(uint64_t period) = 0;
+
+				virtual void start() = 0;
+				virtual void stop() = 0;
+				virtual void reset() = 0;
+
+				uint64_t frequency() const { return _frequency; }
+
+			private:
+				uint64_t _frequency;
+			};
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,35 @@
+/*
+ * Host stand-in for <infos/kernel/device-manager.h>
+ */
+#ifndef SIM_INFOS_KERNEL_DEVICE_MANAGER_H
+#define SIM_INFOS_KERNEL_DEVICE_MANAGER_H
+
+#include <infos/drivers/device.h>
+
+namespace infos {
+	namespace kernel {
+		/**
+		 * The simulator has exactly one device: the simulated CPU's timer.
+		 */
+		class DeviceManager {
+		public:
+			DeviceManager() : _timer(NULL) { }
+
+			void register_timer(drivers::Device *timer) { _timer = timer; }
+
+			template<class T>
+			bool try_get_device_by_class(const drivers::DeviceClass& device_class, T*& device)
+			{
+				if (!_timer || !_timer->device_class().is(device_class)) return false;
+
+				device = (T *) _timer;
+				return true;
+			}
+
+		private:
+			drivers::Device *_timer;
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,33 @@
+/*
+ * Host stand-in for <infos/kernel/kernel.h>
+ */
+#ifndef SIM_INFOS_KERNEL_KERNEL_H
+#define SIM_INFOS_KERNEL_KERNEL_H
+
+#include <infos/util/time.h>
+#include <infos/kernel/device-manager.h>
+
+namespace infos {
+	namespace kernel {
+		/**
+		 * The simulated kernel, which provides the simulated clock.
+		 */
+		class Kernel {
+		public:
+			Kernel() : _runtime(0) { }
+
+			util::Nanoseconds runtime() const { return _runtime; }
+			void runtime(util::Nanoseconds runtime) { _runtime = runtime; }
+
+			DeviceManager& device_manager() { return _device_manager; }
+
+		private:
+			util::Nanoseconds _runtime;
+			DeviceManager _device_manager;
+		};
+
+		extern Kernel sys;
+	}
+}
+
+#endif
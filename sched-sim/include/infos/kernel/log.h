@@ -0,0 +1,43 @@
+/*
+ * Host stand-in for <infos/kernel/log.h>
+ */
+#ifndef SIM_INFOS_KERNEL_LOG_H
+#define SIM_INFOS_KERNEL_LOG_H
+
+#include <infos/define.h>
+
+namespace infos {
+	namespace kernel {
+		namespace LogLevel {
+			enum LogLevel {
+				DEBUG,
+				INFO,
+				NOTICE,
+				WARNING,
+				ERROR,
+				FATAL
+			};
+		}
+
+		/**
+		 * A log, which writes to stderr when enabled.
+		 */
+		class ComponentLog {
+		public:
+			ComponentLog(const char *component) : _component(component), _enabled(false) { }
+
+			void messagef(LogLevel::LogLevel level, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+			void enable() { _enabled = true; }
+			void disable() { _enabled = false; }
+
+		private:
+			const char *_component;
+			bool _enabled;
+		};
+
+		extern ComponentLog syslog;
+	}
+}
+
+#endif
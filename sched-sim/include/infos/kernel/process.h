@@ -0,0 +1,9 @@
+/*
+ * Host stand-in for <infos/kernel/process.h>
+ */
+#ifndef SIM_INFOS_KERNEL_PROCESS_H
+#define SIM_INFOS_KERNEL_PROCESS_H
+
+#include <infos/kernel/thread.h>
+
+#endif
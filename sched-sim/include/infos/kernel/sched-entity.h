@@ -0,0 +1,64 @@
+/*
+ * Host stand-in for <infos/kernel/sched-entity.h>
+ */
+#ifndef SIM_INFOS_KERNEL_SCHED_ENTITY_H
+#define SIM_INFOS_KERNEL_SCHED_ENTITY_H
+
+#include <infos/util/time.h>
+
+namespace infos {
+	namespace kernel {
+		namespace SchedulingEntityState {
+			enum SchedulingEntityState {
+				STOPPED,
+				SLEEPING,
+				RUNNABLE,
+				RUNNING
+			};
+		}
+
+		namespace SchedulingEntityPriority {
+			enum SchedulingEntityPriority {
+				REALTIME,
+				INTERACTIVE,
+				NORMAL,
+				DAEMON,
+				IDLE
+			};
+		}
+
+		/**
+		 * Something that can be scheduled.  The simulator drives the state and the CPU
+		 * time accounting, in the same way the kernel's Scheduler does.
+		 */
+		class SchedulingEntity {
+		public:
+			typedef util::Nanoseconds SchedulingEntityRuntime;
+
+			SchedulingEntity(SchedulingEntityPriority::SchedulingEntityPriority priority)
+				: _state(SchedulingEntityState::STOPPED), _cpu_runtime(0), _exec_start_time(0), _priority(priority) { }
+
+			virtual ~SchedulingEntity() { }
+
+			SchedulingEntityRuntime cpu_runtime() const { return _cpu_runtime; }
+			void increment_cpu_runtime(SchedulingEntityRuntime delta) { _cpu_runtime = _cpu_runtime + delta; }
+
+			SchedulingEntityRuntime exec_start_time() const { return _exec_start_time; }
+			void update_exec_start_time(SchedulingEntityRuntime time) { _exec_start_time = time; }
+
+			SchedulingEntityState::SchedulingEntityState state() const { return _state; }
+			void state(SchedulingEntityState::SchedulingEntityState state) { _state = state; }
+
+			bool stopped() const { return _state == SchedulingEntityState::STOPPED; }
+
+			SchedulingEntityPriority::SchedulingEntityPriority priority() const { return _priority; }
+
+		private:
+			SchedulingEntityState::SchedulingEntityState _state;
+			SchedulingEntityRuntime _cpu_runtime, _exec_start_time;
+			SchedulingEntityPriority::SchedulingEntityPriority _priority;
+		};
+	}
+}
+
+#endif
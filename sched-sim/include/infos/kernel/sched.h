@@ -0,0 +1,48 @@
+/*
+ * Host stand-in for <infos/kernel/sched.h>
+ */
+#ifndef SIM_INFOS_KERNEL_SCHED_H
+#define SIM_INFOS_KERNEL_SCHED_H
+
+#include <infos/define.h>
+#include <infos/kernel/sched-entity.h>
+#include <infos/kernel/log.h>
+
+namespace infos {
+	namespace kernel {
+		class SchedulingAlgorithm {
+		public:
+			virtual ~SchedulingAlgorithm() { }
+
+			virtual const char *name() const = 0;
+			virtual void init() { }
+
+			virtual void add_to_runqueue(SchedulingEntity& entity) = 0;
+			virtual void remove_from_runqueue(SchedulingEntity& entity) = 0;
+			virtual SchedulingEntity *pick_next_entity() = 0;
+		};
+
+		extern ComponentLog sched_log;
+	}
+}
+
+namespace sim {
+	typedef infos::kernel::SchedulingAlgorithm *(*SchedulingAlgorithmFactory)();
+
+	/**
+	 * Records a scheduling algorithm, so that the simulator can create fresh instances
+	 * of it by name.
+	 */
+	struct RegisteredScheduler {
+		RegisteredScheduler(SchedulingAlgorithmFactory factory);
+
+		SchedulingAlgorithmFactory factory;
+		RegisteredScheduler *next;
+	};
+}
+
+#define RegisterScheduler(_class) \
+	static infos::kernel::SchedulingAlgorithm *__sched_alg_create_##_class() { return new _class(); } \
+	static sim::RegisteredScheduler __sched_alg_##_class(__sched_alg_create_##_class)
+
+#endif
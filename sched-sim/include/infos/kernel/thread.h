@@ -0,0 +1,29 @@
+/*
+ * Host stand-in for <infos/kernel/thread.h>
+ */
+#ifndef SIM_INFOS_KERNEL_THREAD_H
+#define SIM_INFOS_KERNEL_THREAD_H
+
+#include <infos/kernel/sched-entity.h>
+
+namespace infos {
+	namespace kernel {
+		class Process;
+
+		class Thread : public SchedulingEntity {
+		public:
+			Thread(Process& owner, SchedulingEntityPriority::SchedulingEntityPriority priority)
+				: SchedulingEntity(priority), _owner(owner) { }
+
+			Process& owner() const { return _owner; }
+
+		private:
+			Process& _owner;
+		};
+
+		class Process {
+		};
+	}
+}
+
+#endif
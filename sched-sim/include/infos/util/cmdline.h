@@ -0,0 +1,33 @@
+/*
+ * Host stand-in for <infos/util/cmdline.h>
+ *
+ * Command-line arguments are collected into a registry, so that the simulator can
+ * apply a kernel command-line given on its own command-line.
+ */
+#ifndef SIM_INFOS_UTIL_CMDLINE_H
+#define SIM_INFOS_UTIL_CMDLINE_H
+
+namespace sim {
+	typedef void (*CmdLineHandler)(const char *value);
+
+	struct CmdLineArgument {
+		CmdLineArgument(const char *key, CmdLineHandler handler);
+
+		const char *key;
+		CmdLineHandler handler;
+		CmdLineArgument *next;
+	};
+
+	/**
+	 * Applies a kernel command-line (space separated key=value pairs) to every registered
+	 * argument handler.
+	 */
+	extern void apply_cmdline(const char *cmdline);
+}
+
+#define RegisterCmdLineArgument(_name, _key) \
+	static void __cmdline_handler_##_name(const char *value); \
+	static sim::CmdLineArgument __cmdline_arg_##_name(_key, __cmdline_handler_##_name); \
+	static void __cmdline_handler_##_name(const char *value)
+
+#endif
@@ -0,0 +1,19 @@
+/*
+ * Host stand-in for <infos/util/lock.h>
+ *
+ * The simulator runs a single simulated CPU on a single host thread, so disabling
+ * interrupts is a no-op.
+ */
+#ifndef SIM_INFOS_UTIL_LOCK_H
+#define SIM_INFOS_UTIL_LOCK_H
+
+namespace infos {
+	namespace util {
+		class UniqueIRQLock {
+		public:
+			UniqueIRQLock() { }
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,19 @@
+/*
+ * Host stand-in for <infos/util/string.h>
+ */
+#ifndef SIM_INFOS_UTIL_STRING_H
+#define SIM_INFOS_UTIL_STRING_H
+
+#include <string.h>
+
+namespace infos {
+	namespace util {
+		using ::strlen;
+		using ::strncmp;
+		using ::strncpy;
+		using ::memcpy;
+		using ::memset;
+	}
+}
+
+#endif
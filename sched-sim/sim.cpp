@@ -0,0 +1,808 @@
+/*
+ * Host-side Scheduler Simulator
+ *
+ * Runs the real scheduling algorithm code from ../coursework on the host, against
+ * stand-in kernel headers (see include/), and drives it with a synthetic or recorded
+ * workload.  The simulated kernel behaves like InfOS: a scheduling event happens on a
+ * CPU when its timer fires, or when its running thread blocks or exits, and the CPU
+ * time accounting is brought up to date before every event.  Threads arrive, and wake
+ * up from I/O, on the boot CPU.
+ *
+ * Usage: sched-sim [options]
+ *
+ *   --alg=A,B,...	The algorithms to run (default: every registered algorithm).
+ *   --workload=W	A synthetic workload: mixed, cpu, io, tenants, pingpong or
+ *			realtime (default mixed).  In the tenants workload, half of the
+ *			tasks are threads of one process, and the rest are processes of
+ *			their own.  In the pingpong workload, half of the tasks are
+ *			pairs of threads passing messages back and forth, and the rest
+ *			are CPU-bound.  In the realtime workload, every eighth task is
+ *			periodic, and the rest are CPU-bound; under the "edf" algorithm,
+ *			the periodic tasks ask for a reservation with sched::set_deadline.
+ *   --trace=FILE	A recorded workload, instead of a synthetic one (see below).
+ *   --tasks=N		The number of tasks in a synthetic workload (default 200).
+ *   --seed=N		The random seed for a synthetic workload (default 1).
+ *   --tick=MS		The periodic timer tick, in milliseconds (default 10).
+ *   --cpus=N		The number of simulated CPUs (default 1).  Only rr keeps
+ *			per-CPU state, so the other algorithms are skipped when N > 1.
+ *   --cmdline=STR	A kernel command-line, applied before the algorithms are created.
+ *   --max-time=S	Give up after this much simulated time, in seconds (default 3600).
+ *   --verbose		Enable the scheduler's debug log.
+ *
+ * A trace file has one task per line (blank lines and lines starting with '#' are
+ * ignored):
+ *
+ *   <arrival-us> <priority> <process> <cpu-us> [<io-us> <cpu-us> ...]
+ *
+ * where <priority> is one of realtime, interactive, normal, daemon or idle, and tasks
+ * with the same <process> number are threads of the same process.
+ */
+#include <infos/kernel/sched.h>
+#include <infos/kernel/thread.h>
+#include <infos/kernel/kernel.h>
+#include <infos/drivers/timer/lapic-timer.h>
+#include <infos/util/cmdline.h>
+#include <infos/assert.h>
+
+#include "sched-runqueue.h"
+#include "sched-control.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include <algorithm>
+#include <queue>
+#include <string>
+#include <vector>
+
+using namespace infos::kernel;
+using namespace infos::drivers;
+using namespace infos::drivers::timer;
+using namespace infos::util;
+
+#define MS	1000000ULL
+#define US	1000ULL
+
+// The simulated timer frequency, which matches the calibrated LAPIC timer.
+#define TIMER_FREQUENCY	1000000000ULL
+
+/* --- Stand-in kernel definitions --- */
+
+Kernel infos::kernel::sys;
+ComponentLog infos::kernel::syslog("syslog");
+ComponentLog infos::kernel::sched_log("sched");
+
+const DeviceClass Timer::TimerDeviceClass(NULL);
+const DeviceClass LAPICTimer::LAPICTimerDeviceClass(&Timer::TimerDeviceClass);
+
+// The simulated CPU that is executing, whose APIC ID is its number, and each simulated
+// CPU's tag.
+static unsigned int sim_cpu;
+static unsigned int sim_cpu_tags[SCHED_MAX_CPUS];
+
+unsigned int sched::current_apic_id() { return sim_cpu; }
+bool sched::has_cpu_tag() { return true; }
+unsigned int sched::current_cpu_tag() { return sim_cpu_tags[sim_cpu]; }
+void sched::set_cpu_tag(unsigned int tag) { sim_cpu_tags[sim_cpu] = tag; }
+
+// Warnings and errors are always printed, as the kernel would, whether or not --verbose
+// enabled the rest of the log.
+void ComponentLog::messagef(LogLevel::LogLevel level, const char *format, ...)
+{
+	static const char *names[] = { "debug", "info", "notice", "warning", "error", "fatal" };
+	if (!_enabled && level < LogLevel::WARNING) return;
+
+	va_list args;
+	va_start(args, format);
+
+	fprintf(stderr, "[%12lu] %s: %s: ", sys.runtime().count(), _component, names[level]);
+	vfprintf(stderr, format, args);
+	fprintf(stderr, "\n");
+
+	va_end(args);
+}
+
+void LAPICTimer::start()
+{
+	_running = true;
+	_start = sys.runtime().count();
+}
+
+uint64_t LAPICTimer::expiry() const
+{
+	return _start + ((_period * 1000000000ULL) / frequency());
+}
+
+void LAPICTimer::expired()
+{
+	if (_periodic) {
+		_start = expiry();
+	} else {
+		_running = false;
+	}
+}
+
+static sim::CmdLineArgument *cmdline_arguments;
+
+sim::CmdLineArgument::CmdLineArgument(const char *key, CmdLineHandler handler)
+	: key(key), handler(handler), next(cmdline_arguments)
+{
+	cmdline_arguments = this;
+}
+
+void sim::apply_cmdline(const char *cmdline)
+{
+	std::string args(cmdline);
+	size_t pos = 0;
+
+	while (pos < args.size()) {
+		size_t end = args.find(' ', pos);
+		if (end == std::string::npos) end = args.size();
+
+		std::string arg = args.substr(pos, end - pos);
+		size_t eq = arg.find('=');
+
+		if (eq != std::string::npos) {
+			std::string key = arg.substr(0, eq);
+			bool found = false;
+
+			for (CmdLineArgument *a = cmdline_arguments; a; a = a->next) {
+				if (key == a->key) {
+					a->handler(arg.c_str() + eq + 1);
+					found = true;
+				}
+			}
+
+			if (!found) fprintf(stderr, "warning: unknown command-line argument '%s'\n", key.c_str());
+		}
+
+		pos = end + 1;
+	}
+}
+
+static sim::RegisteredScheduler *registered_schedulers;
+
+sim::RegisteredScheduler::RegisteredScheduler(SchedulingAlgorithmFactory factory)
+	: factory(factory), next(registered_schedulers)
+{
+	registered_schedulers = this;
+}
+
+/* --- Workloads --- */
+
+/**
+ * A task in the workload: it arrives, then alternates between CPU bursts and I/O waits,
+ * finishing after its last CPU burst.
+ */
+struct Task {
+	Task() : arrival(0), priority(SchedulingEntityPriority::NORMAL), process(0), partner(-1), period(0), deadline(0) { }
+
+	uint64_t arrival;
+	SchedulingEntityPriority::SchedulingEntityPriority priority;
+	unsigned int process;
+
+	// CPU burst, I/O wait, CPU burst, ..., CPU burst.
+	std::vector<uint64_t> phases;
+
+	// The task this task passes messages to, or -1.  Such a task waits for a message
+	// from its partner, rather than for I/O, between its CPU bursts.
+	int partner;
+
+	// For a periodic task, the period at which its CPU bursts are released, and the
+	// deadline (relative to each release) by which each burst should be done, or zero.
+	// The I/O waits between its bursts are unused: it sleeps until its next release.
+	uint64_t period, deadline;
+
+	uint64_t demand() const
+	{
+		uint64_t total = 0;
+		for (size_t i = 0; i < phases.size(); i += 2) total += phases[i];
+		return total;
+	}
+
+	bool cpu_bound() const { return phases.size() == 1; }
+};
+
+static uint64_t rng_state;
+
+static uint64_t rng()
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+static uint64_t rng_range(uint64_t lo, uint64_t hi)
+{
+	return lo + (rng() % (hi - lo + 1));
+}
+
+/**
+ * Generates a synthetic workload.  Interactive tasks make many short CPU bursts with
+ * I/O waits in between; batch tasks make a single long CPU burst.  Each task is a
+ * process of its own, except in the tenants workload.
+ */
+static std::vector<Task> generate_workload(const std::string& kind, unsigned int nr_tasks, uint64_t seed)
+{
+	std::vector<Task> tasks;
+	rng_state = seed * 0x9e3779b97f4a7c15ULL + 1;
+
+	// Spread the arrivals so that the CPU is roughly saturated.
+	uint64_t arrival_window = nr_tasks * 10 * MS;
+
+	for (unsigned int i = 0; i < nr_tasks; i++) {
+		if (kind == "pingpong") {
+			Task task;
+			task.arrival = 0;
+			task.priority = SchedulingEntityPriority::NORMAL;
+			task.process = i;
+
+			if (i < nr_tasks / 2) {
+				task.process = i & ~1;
+				task.partner = (i ^ 1) < nr_tasks / 2 ? (i ^ 1) : -1;
+			}
+
+			if (task.partner >= 0) {
+				for (unsigned int b = 0; b < 100; b++) {
+					if (b > 0) task.phases.push_back(0);
+					task.phases.push_back(50 * US);
+				}
+			} else {
+				task.phases.push_back(rng_range(100 * MS, 500 * MS));
+			}
+
+			tasks.push_back(task);
+			continue;
+		}
+
+		if (kind == "realtime" && (i % 8) == 0) {
+			Task task;
+			task.arrival = rng_range(0, 100 * MS);
+			task.priority = SchedulingEntityPriority::REALTIME;
+			task.process = i;
+			task.period = rng_range(50, 100) * MS;
+			task.deadline = rng_range(task.period / 2, task.period);
+
+			uint64_t runtime = rng_range(500 * US, 2 * MS);
+			for (unsigned int b = 0; b < 50; b++) {
+				if (b > 0) task.phases.push_back(0);
+				task.phases.push_back(runtime);
+			}
+
+			tasks.push_back(task);
+			continue;
+		}
+
+		bool interactive;
+		if (kind == "cpu" || kind == "tenants" || kind == "realtime") {
+			interactive = false;
+		} else if (kind == "io") {
+			interactive = true;
+		} else {
+			interactive = (rng() % 4) == 0;
+		}
+
+		Task task;
+		task.arrival = rng_range(0, arrival_window);
+		task.process = (kind == "tenants" && (i % 2) == 0) ? 0 : i;
+
+		if (interactive) {
+			task.priority = SchedulingEntityPriority::INTERACTIVE;
+
+			unsigned int nr_bursts = rng_range(10, 30);
+			for (unsigned int b = 0; b < nr_bursts; b++) {
+				if (b > 0) task.phases.push_back(rng_range(5 * MS, 20 * MS));
+				task.phases.push_back(rng_range(500 * US, 2 * MS));
+			}
+		} else {
+			task.priority = SchedulingEntityPriority::NORMAL;
+			task.phases.push_back(rng_range(20 * MS, 200 * MS));
+		}
+
+		tasks.push_back(task);
+	}
+
+	// Tasks that arrive together keep their order, so that partners can be found by index.
+	std::stable_sort(tasks.begin(), tasks.end(), [](const Task& a, const Task& b) { return a.arrival < b.arrival; });
+	return tasks;
+}
+
+/**
+ * Loads a recorded workload from a trace file.
+ */
+static bool load_trace(const char *filename, std::vector<Task>& tasks)
+{
+	FILE *f = fopen(filename, "r");
+	if (!f) {
+		perror(filename);
+		return false;
+	}
+
+	char line[4096];
+	unsigned int lineno = 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+
+		char *p = line;
+		while (*p == ' ' || *p == '\t') p++;
+		if (*p == '#' || *p == '\n' || *p == 0) continue;
+
+		char priority[32];
+		unsigned long arrival;
+		unsigned int process;
+		int consumed;
+
+		if (sscanf(p, "%lu %31s %u%n", &arrival, priority, &process, &consumed) != 3) {
+			fprintf(stderr, "%s:%u: malformed task\n", filename, lineno);
+			fclose(f);
+			return false;
+		}
+
+		Task task;
+		task.arrival = arrival * US;
+		task.process = process;
+
+		if (!strcmp(priority, "realtime")) task.priority = SchedulingEntityPriority::REALTIME;
+		else if (!strcmp(priority, "interactive")) task.priority = SchedulingEntityPriority::INTERACTIVE;
+		else if (!strcmp(priority, "daemon")) task.priority = SchedulingEntityPriority::DAEMON;
+		else if (!strcmp(priority, "idle")) task.priority = SchedulingEntityPriority::IDLE;
+		else task.priority = SchedulingEntityPriority::NORMAL;
+
+		p += consumed;
+
+		unsigned long phase;
+		while (sscanf(p, "%lu%n", &phase, &consumed) == 1) {
+			task.phases.push_back(phase * US);
+			p += consumed;
+		}
+
+		if (task.phases.size() % 2 == 0) {
+			fprintf(stderr, "%s:%u: a task must end with a CPU burst\n", filename, lineno);
+			fclose(f);
+			return false;
+		}
+
+		tasks.push_back(task);
+	}
+
+	fclose(f);
+
+	std::stable_sort(tasks.begin(), tasks.end(), [](const Task& a, const Task& b) { return a.arrival < b.arrival; });
+	return true;
+}
+
+/* --- Simulation --- */
+
+/**
+ * A simulated thread, running one task of the workload.
+ */
+class SimThread : public Thread {
+public:
+	SimThread(Process& owner, const Task& task)
+		: Thread(owner, task.priority), task(task), phase(0), remaining(task.phases[0]), first_run(0), finish(0), started(false),
+		  partner(NULL), inbox(0), waiting(false), release(0) { }
+
+	const Task& task;
+
+	// The current phase, and the time left in it.
+	size_t phase;
+	uint64_t remaining;
+
+	uint64_t first_run, finish;
+	bool started;
+
+	// The thread this one passes messages to, the number of messages it has received
+	// but not consumed, and whether it is blocked waiting for one.
+	SimThread *partner;
+	unsigned int inbox;
+	bool waiting;
+
+	// For a periodic task, when its current CPU burst was released.
+	uint64_t release;
+};
+
+/**
+ * The results of one simulation run.
+ */
+struct Results {
+	unsigned int nr_finished;
+	uint64_t end_time;
+	uint64_t nr_switches, nr_timer_irqs, nr_events;
+
+	// The CPU bursts of periodic tasks, and how many of them missed their deadlines.
+	uint64_t nr_jobs, nr_missed;
+
+	std::vector<uint64_t> turnaround, response;
+	double fairness;
+	double wall_seconds;
+};
+
+/**
+ * Mirrors the kernel's Scheduler::set_entity_state: the entity's state is updated, and
+ * then the algorithm is told whether it joined or left the runqueue.
+ */
+static void set_state(SchedulingAlgorithm& algorithm, SimThread& thread, SchedulingEntityState::SchedulingEntityState state)
+{
+	if (thread.state() == state) return;
+
+	bool was_runnable = thread.state() == SchedulingEntityState::RUNNABLE;
+	thread.state(state);
+
+	if (state == SchedulingEntityState::RUNNABLE) {
+		algorithm.add_to_runqueue(thread);
+	} else if (was_runnable) {
+		algorithm.remove_from_runqueue(thread);
+	}
+}
+
+static uint64_t percentile(std::vector<uint64_t> values, unsigned int p)
+{
+	if (values.empty()) return 0;
+
+	std::sort(values.begin(), values.end());
+	return values[std::min(values.size() - 1, (values.size() * p) / 100)];
+}
+
+static uint64_t mean(const std::vector<uint64_t>& values)
+{
+	if (values.empty()) return 0;
+
+	uint64_t total = 0;
+	for (uint64_t v : values) total += v;
+	return total / values.size();
+}
+
+/**
+ * Runs a workload to completion under a scheduling algorithm, on a number of CPUs.
+ */
+static Results simulate(SchedulingAlgorithm& algorithm, const std::vector<Task>& tasks, unsigned int nr_cpus, uint64_t tick, bool reserve,
+	uint64_t max_time)
+{
+	struct timespec wall_start, wall_end;
+	clock_gettime(CLOCK_MONOTONIC, &wall_start);
+
+	Results results = { };
+
+	sys.runtime(0);
+
+	// Each run starts on a freshly booted machine.
+	sim_cpu = 0;
+	for (unsigned int i = 0; i < SCHED_MAX_CPUS; i++) sim_cpu_tags[i] = 0;
+
+	// Every CPU has a timer, but, as in InfOS, only the boot CPU's is registered with
+	// the device manager, so the others always tick periodically.
+	std::vector<LAPICTimer> timers(nr_cpus, LAPICTimer(TIMER_FREQUENCY));
+	sys.device_manager().register_timer(&timers[0]);
+
+	for (LAPICTimer& timer : timers) {
+		timer.init_periodic((tick * TIMER_FREQUENCY) / 1000000000ULL);
+		timer.start();
+	}
+
+	unsigned int nr_processes = 0;
+	for (const Task& task : tasks) nr_processes = std::max(nr_processes, task.process + 1);
+
+	std::vector<Process> processes(nr_processes);
+	std::vector<SimThread *> threads;
+	threads.reserve(tasks.size());
+
+	// The thread running each task, once it has arrived.
+	std::vector<SimThread *> task_threads(tasks.size(), NULL);
+
+	// Threads waiting for I/O, ordered by wake-up time.
+	typedef std::pair<uint64_t, SimThread *> Wakeup;
+	std::priority_queue<Wakeup, std::vector<Wakeup>, std::greater<Wakeup>> sleepers;
+
+	size_t next_arrival = 0;
+	std::vector<SimThread *> running(nr_cpus, NULL);
+	uint64_t now = 0;
+
+	algorithm.init();
+
+	while (results.nr_finished < tasks.size() && now < max_time) {
+		// Find the next thing that happens.
+		uint64_t next = max_time;
+
+		if (next_arrival < tasks.size()) next = std::min(next, tasks[next_arrival].arrival);
+		if (!sleepers.empty()) next = std::min(next, sleepers.top().first);
+
+		for (unsigned int cpu = 0; cpu < nr_cpus; cpu++) {
+			if (running[cpu]) next = std::min(next, now + running[cpu]->remaining);
+			if (timers[cpu].running()) next = std::max(now, std::min(next, timers[cpu].expiry()));
+		}
+
+		// Run each CPU's current thread up to that point.
+		for (SimThread *current : running) {
+			if (!current) continue;
+
+			current->remaining -= next - now;
+			current->increment_cpu_runtime(next - now);
+		}
+
+		now = next;
+		sys.runtime(now);
+
+		std::vector<bool> reschedule(nr_cpus, false);
+
+		// Arrivals and I/O completions are handled by the boot CPU, which takes the
+		// device interrupts.
+		sim_cpu = 0;
+
+		// Start any threads that have arrived.
+		while (next_arrival < tasks.size() && tasks[next_arrival].arrival <= now) {
+			const Task& task = tasks[next_arrival];
+
+			SimThread *thread = new SimThread(processes[task.process], task);
+			threads.push_back(thread);
+			task_threads[next_arrival++] = thread;
+
+			// Of each pair of partners, the second to arrive starts off waiting for the
+			// first one's message.
+			if (task.partner >= 0 && task_threads[task.partner]) {
+				thread->partner = task_threads[task.partner];
+				thread->partner->partner = thread;
+				thread->waiting = true;
+
+				set_state(algorithm, *thread, SchedulingEntityState::SLEEPING);
+				results.nr_events++;
+				continue;
+			}
+
+			set_state(algorithm, *thread, SchedulingEntityState::RUNNABLE);
+			results.nr_events++;
+
+			// A periodic task asks for a reservation once it is known to the algorithm.
+			// If it is not admitted, it runs in the normal class.
+			if (task.period) {
+				thread->release = now;
+				if (reserve) sched::set_deadline(*thread, task.phases[0], task.period, task.deadline);
+			}
+		}
+
+		// Wake any threads whose I/O has completed.
+		while (!sleepers.empty() && sleepers.top().first <= now) {
+			SimThread *thread = sleepers.top().second;
+			thread->release = sleepers.top().first;
+			sleepers.pop();
+
+			thread->phase++;
+			thread->remaining = thread->task.phases[thread->phase];
+
+			set_state(algorithm, *thread, SchedulingEntityState::RUNNABLE);
+			results.nr_events++;
+		}
+
+		// Then each CPU deals with its own thread, and its own timer.
+		for (unsigned int cpu = 0; cpu < nr_cpus; cpu++) {
+			SimThread *&current = running[cpu];
+			sim_cpu = cpu;
+
+			// The current thread has finished its CPU burst, and has a partner, so it
+			// sends the partner a message, and then either exits, or waits for a
+			// message back.
+			if (current && current->remaining == 0 && current->partner) {
+				SimThread *partner = current->partner;
+
+				if (partner->waiting) {
+					partner->waiting = false;
+					partner->phase += 2;
+					partner->remaining = partner->task.phases[partner->phase];
+
+					set_state(algorithm, *partner, SchedulingEntityState::RUNNABLE);
+				} else {
+					partner->inbox++;
+				}
+
+				if (current->phase + 1 >= current->task.phases.size()) {
+					current->finish = now;
+					results.nr_finished++;
+
+					set_state(algorithm, *current, SchedulingEntityState::STOPPED);
+					current = NULL;
+				} else if (current->inbox > 0) {
+					current->inbox--;
+					current->phase += 2;
+					current->remaining = current->task.phases[current->phase];
+				} else {
+					current->waiting = true;
+
+					set_state(algorithm, *current, SchedulingEntityState::SLEEPING);
+					current = NULL;
+				}
+
+				// A thread that carries straight on causes no scheduling event.
+				if (!current) reschedule[cpu] = true;
+				results.nr_events++;
+			}
+
+			// The current thread has finished its CPU burst, so it either starts
+			// waiting for I/O (or its next release, if it is periodic), or exits.
+			if (current && current->remaining == 0) {
+				if (current->task.period) {
+					results.nr_jobs++;
+					if (now > current->release + current->task.deadline) results.nr_missed++;
+				}
+
+				if (current->phase + 1 < current->task.phases.size() && current->task.period) {
+					current->phase++;
+
+					uint64_t wakeup = std::max(now, current->release + current->task.period);
+					sleepers.push(Wakeup(wakeup, current));
+
+					set_state(algorithm, *current, SchedulingEntityState::SLEEPING);
+				} else if (current->phase + 1 < current->task.phases.size()) {
+					current->phase++;
+
+					uint64_t wakeup = now + current->task.phases[current->phase];
+					sleepers.push(Wakeup(wakeup, current));
+
+					set_state(algorithm, *current, SchedulingEntityState::SLEEPING);
+				} else {
+					current->finish = now;
+					results.nr_finished++;
+
+					set_state(algorithm, *current, SchedulingEntityState::STOPPED);
+				}
+
+				current = NULL;
+				reschedule[cpu] = true;
+				results.nr_events++;
+			}
+
+			if (timers[cpu].running() && timers[cpu].expiry() <= now) {
+				timers[cpu].expired();
+				results.nr_timer_irqs++;
+				reschedule[cpu] = true;
+			}
+		}
+
+		// Make the scheduling decisions, exactly as the kernel would.
+		for (unsigned int cpu = 0; cpu < nr_cpus; cpu++) {
+			if (!reschedule[cpu]) continue;
+			sim_cpu = cpu;
+
+			SimThread *prev = running[cpu];
+			SimThread *current = (SimThread *) algorithm.pick_next_entity();
+			running[cpu] = current;
+			results.nr_events++;
+
+			if (current != prev) results.nr_switches++;
+			if (!current) continue;
+
+			assert(current->state() == SchedulingEntityState::RUNNABLE);
+
+			// A thread can only run on one CPU at a time.
+			for (unsigned int other = 0; other < nr_cpus; other++) {
+				assert(other == cpu || running[other] != current);
+			}
+
+			if (!current->started) {
+				current->started = true;
+				current->first_run = now;
+			}
+		}
+	}
+
+	// Collect the per-task metrics.
+	std::vector<double> rates;
+	for (SimThread *thread : threads) {
+		if (!thread->finish) continue;
+
+		uint64_t turnaround = thread->finish - thread->task.arrival;
+		results.turnaround.push_back(turnaround);
+		results.response.push_back(thread->first_run - thread->task.arrival);
+
+		if (thread->task.cpu_bound()) rates.push_back((double) thread->task.demand() / turnaround);
+	}
+
+	// Jain's fairness index over the progress rate of the CPU-bound tasks.
+	double sum = 0, sum_sq = 0;
+	for (double r : rates) {
+		sum += r;
+		sum_sq += r * r;
+	}
+
+	results.fairness = sum_sq > 0 ? (sum * sum) / (rates.size() * sum_sq) : 1.0;
+	results.end_time = now;
+
+	for (SimThread *thread : threads) delete thread;
+
+	clock_gettime(CLOCK_MONOTONIC, &wall_end);
+	results.wall_seconds = (wall_end.tv_sec - wall_start.tv_sec) + (wall_end.tv_nsec - wall_start.tv_nsec) / 1e9;
+
+	return results;
+}
+
+static bool selected(const std::string& list, const char *name)
+{
+	if (list.empty()) return true;
+
+	std::string padded = "," + list + ",";
+	return padded.find("," + std::string(name) + ",") != std::string::npos;
+}
+
+int main(int argc, char **argv)
+{
+	std::string algorithms, workload = "mixed", trace, cmdline;
+	unsigned int nr_tasks = 200, nr_cpus = 1;
+	uint64_t seed = 1, tick = 10 * MS, max_time = 3600ULL * 1000 * MS;
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+
+		if (!strncmp(arg, "--alg=", 6)) algorithms = arg + 6;
+		else if (!strncmp(arg, "--workload=", 11)) workload = arg + 11;
+		else if (!strncmp(arg, "--trace=", 8)) trace = arg + 8;
+		else if (!strncmp(arg, "--tasks=", 8)) nr_tasks = strtoul(arg + 8, NULL, 0);
+		else if (!strncmp(arg, "--seed=", 7)) seed = strtoull(arg + 7, NULL, 0);
+		else if (!strncmp(arg, "--tick=", 7)) tick = strtoull(arg + 7, NULL, 0) * MS;
+		else if (!strncmp(arg, "--cpus=", 7)) nr_cpus = strtoul(arg + 7, NULL, 0);
+		else if (!strncmp(arg, "--cmdline=", 10)) cmdline = arg + 10;
+		else if (!strncmp(arg, "--max-time=", 11)) max_time = strtoull(arg + 11, NULL, 0) * 1000 * MS;
+		else if (!strcmp(arg, "--verbose")) sched_log.enable();
+		else {
+			fprintf(stderr, "usage: %s [--alg=A,B] [--workload=mixed|cpu|io|tenants|pingpong|realtime] [--trace=FILE] [--tasks=N] [--seed=N] "
+				"[--tick=MS] [--cpus=N] [--cmdline=STR] [--max-time=S] [--verbose]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (nr_cpus < 1 || nr_cpus > SCHED_MAX_CPUS) {
+		fprintf(stderr, "error: between 1 and %u cpus can be simulated\n", SCHED_MAX_CPUS);
+		return 1;
+	}
+
+	sim::apply_cmdline(cmdline.c_str());
+
+	std::vector<Task> tasks;
+	if (!trace.empty()) {
+		if (!load_trace(trace.c_str(), tasks)) return 1;
+	} else {
+		tasks = generate_workload(workload, nr_tasks, seed);
+	}
+
+	if (tasks.empty()) {
+		fprintf(stderr, "error: the workload is empty\n");
+		return 1;
+	}
+
+	// Run the algorithms in name order, so that the output is stable.
+	std::vector<SchedulingAlgorithm *> candidates;
+	for (sim::RegisteredScheduler *r = registered_schedulers; r; r = r->next) {
+		candidates.push_back(r->factory());
+	}
+
+	std::sort(candidates.begin(), candidates.end(),
+		[](SchedulingAlgorithm *a, SchedulingAlgorithm *b) { return strcmp(a->name(), b->name()) < 0; });
+
+	printf("%-8s %8s %10s %12s %12s %12s %12s %8s %10s %10s %10s %10s %8s\n",
+		"alg", "finished", "tasks/s", "turn-avg-ms", "turn-p95-ms", "resp-avg-ms", "resp-p95-ms",
+		"fairness", "switches", "timer-irqs", "events", "rt-missed", "wall-s");
+
+	for (SchedulingAlgorithm *algorithm : candidates) {
+		if (!selected(algorithms, algorithm->name()) || (nr_cpus > 1 && strcmp(algorithm->name(), "rr"))) {
+			delete algorithm;
+			continue;
+		}
+
+		Results r = simulate(*algorithm, tasks, nr_cpus, tick, !strcmp(algorithm->name(), "edf"), max_time);
+
+		char missed[32];
+		snprintf(missed, sizeof(missed), "%lu/%lu", r.nr_missed, r.nr_jobs);
+
+		printf("%-8s %8u %10.2f %12.2f %12.2f %12.2f %12.2f %8.3f %10lu %10lu %10lu %10s %8.3f\n",
+			algorithm->name(), r.nr_finished, r.end_time ? r.nr_finished / (r.end_time / 1e9) : 0.0,
+			mean(r.turnaround) / 1e6, percentile(r.turnaround, 95) / 1e6,
+			mean(r.response) / 1e6, percentile(r.response, 95) / 1e6,
+			r.fairness, r.nr_switches, r.nr_timer_irqs, r.nr_events, missed, r.wall_seconds);
+
+		delete algorithm;
+	}
+
+	return 0;
+}
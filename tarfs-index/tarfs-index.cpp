@@ -0,0 +1,187 @@
+/*
+ * Host-side tarfs Index Builder
+ *
+ * Appends an index to a TAR archive (see ../coursework/tarfs-index.h), so that tarfs
+ * can mount the archive by reading just the index, rather than every header in it.
+ * Running the tool again on an archive that already has an index replaces the index.
+ * Tools that only understand plain TAR files stop at the end-of-archive marker, and so
+ * never see the index.
+ *
+ * Usage: tarfs-index <archive>
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "tarfs-index.h"
+
+#define BLOCK_SIZE	512
+
+using namespace tarfs;
+
+/**
+ * The parts of a TAR header that the index needs.
+ */
+struct posix_header {
+	char name[100];
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char size[12];
+	char mtime[12];
+	char chksum[8];
+	char typeflag;
+	char linkname[100];
+	char magic[6];
+	char version[2];
+	char uname[32];
+	char gname[32];
+	char devmajor[8];
+	char devminor[8];
+	char prefix[155];
+} __attribute__((packed));
+
+static bool is_zero_block(const uint8_t *block)
+{
+	for (unsigned int i = 0; i < BLOCK_SIZE; i++) {
+		if (block[i] != 0) return false;
+	}
+
+	return true;
+}
+
+/**
+ * Returns a string from a fixed-size header field, which is only null-terminated if it
+ * is shorter than the field.
+ */
+static std::string field(const char *data, size_t size)
+{
+	return std::string(data, strnlen(data, size));
+}
+
+static uint32_t parse_octal(const char *data, size_t size)
+{
+	uint32_t value = 0;
+	for (size_t i = 0; i < size && data[i]; i++) {
+		if (data[i] >= '0' && data[i] <= '7') {
+			value = (value * 8) + (data[i] - '0');
+		}
+	}
+
+	return value;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s <archive>\n", argv[0]);
+		return 1;
+	}
+
+	FILE *f = fopen(argv[1], "r+b");
+	if (!f) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	std::vector<uint8_t> image;
+	uint8_t buffer[65536];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+		image.insert(image.end(), buffer, buffer + n);
+	}
+
+	if (image.size() % BLOCK_SIZE != 0) {
+		fprintf(stderr, "%s: not a whole number of blocks\n", argv[1]);
+		return 1;
+	}
+
+	uint32_t nr_blocks = image.size() / BLOCK_SIZE;
+
+	// Drop any index that is already there, so that it is replaced.
+	if (nr_blocks > 0) {
+		const tarfs_index_trailer *trailer = (const tarfs_index_trailer *) &image[(nr_blocks - 1) * BLOCK_SIZE];
+		if (strncmp(trailer->magic, TARFS_INDEX_MAGIC, TARFS_INDEX_MAGIC_SIZE) == 0 && trailer->table_block < nr_blocks) {
+			nr_blocks = trailer->table_block;
+		}
+	}
+
+	// Walk the archive in the same way as the kernel's scan does.
+	std::vector<tarfs_index_entry> entries;
+	std::string names;
+
+	uint32_t block = 0;
+	while (block < nr_blocks) {
+		const uint8_t *data = &image[block * BLOCK_SIZE];
+
+		if (is_zero_block(data)) {
+			if (block + 1 >= nr_blocks || is_zero_block(data + BLOCK_SIZE)) break;
+
+			block++;
+			continue;
+		}
+
+		const posix_header *header = (const posix_header *) data;
+		uint32_t size = parse_octal(header->size, sizeof(header->size));
+
+		if (header->typeflag != 'x' && header->typeflag != 'g') {
+			std::string path = field(header->name, sizeof(header->name));
+
+			std::string prefix = field(header->prefix, sizeof(header->prefix));
+			if (!prefix.empty()) {
+				path = prefix + "/" + path;
+			}
+
+			tarfs_index_entry entry;
+			memset(&entry, 0, sizeof(entry));
+			entry.data_block = block + 1;
+			entry.size = size;
+			entry.name_offset = names.size();
+			entry.name_length = path.size();
+			entry.type = header->typeflag == '5' ? TARFS_INDEX_DIRECTORY : TARFS_INDEX_FILE;
+
+			entries.push_back(entry);
+			names += path;
+		}
+
+		block += 1 + ((size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+	}
+
+	// Lay out the table, padded to a whole number of blocks, then the trailer.
+	std::vector<uint8_t> table(entries.size() * sizeof(tarfs_index_entry));
+	memcpy(table.data(), entries.data(), table.size());
+	table.insert(table.end(), names.begin(), names.end());
+
+	tarfs_index_trailer trailer;
+	memset(&trailer, 0, sizeof(trailer));
+	memcpy(trailer.magic, TARFS_INDEX_MAGIC, TARFS_INDEX_MAGIC_SIZE);
+	trailer.archive_blocks = nr_blocks;
+	trailer.table_block = nr_blocks;
+	trailer.table_size = table.size();
+	trailer.nr_entries = entries.size();
+	trailer.checksum = tarfs_index_checksum(table.data(), table.size());
+
+	table.resize(((table.size() + BLOCK_SIZE - 1) / BLOCK_SIZE) * BLOCK_SIZE, 0);
+
+	uint8_t trailer_block[BLOCK_SIZE];
+	memset(trailer_block, 0, sizeof(trailer_block));
+	memcpy(trailer_block, &trailer, sizeof(trailer));
+
+	if (fseek(f, (long) nr_blocks * BLOCK_SIZE, SEEK_SET) != 0
+	    || fwrite(table.data(), 1, table.size(), f) != table.size()
+	    || fwrite(trailer_block, 1, sizeof(trailer_block), f) != sizeof(trailer_block)
+	    || ftruncate(fileno(f), ftell(f)) != 0) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	fclose(f);
+
+	printf("%s: indexed %zu entries in %zu blocks\n", argv[1], entries.size(), (table.size() / BLOCK_SIZE) + 1);
+	return 0;
+}
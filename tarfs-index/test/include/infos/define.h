@@ -0,0 +1,15 @@
+/*
+ * Host stand-in for <infos/define.h>
+ */
+#ifndef TEST_INFOS_DEFINE_H
+#define TEST_INFOS_DEFINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define __packed		__attribute__((packed))
+#define __page_bits		12
+#define __page_size		(1 << __page_bits)
+
+#endif
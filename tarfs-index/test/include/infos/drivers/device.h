@@ -0,0 +1,36 @@
+/*
+ * Host stand-in for <infos/drivers/device.h>
+ */
+#ifndef TEST_INFOS_DRIVERS_DEVICE_H
+#define TEST_INFOS_DRIVERS_DEVICE_H
+
+#include <infos/define.h>
+
+namespace infos {
+	namespace drivers {
+		class DeviceClass {
+		public:
+			DeviceClass(const DeviceClass *parent) : _parent(parent) { }
+
+			bool is(const DeviceClass& other) const
+			{
+				for (const DeviceClass *dc = this; dc; dc = dc->_parent) {
+					if (dc == &other) return true;
+				}
+
+				return false;
+			}
+
+		private:
+			const DeviceClass *_parent;
+		};
+
+		class Device {
+		public:
+			virtual ~Device() { }
+			virtual const DeviceClass& device_class() const = 0;
+		};
+	}
+}
+
+#endif
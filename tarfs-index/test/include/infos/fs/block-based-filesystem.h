@@ -0,0 +1,24 @@
+/*
+ * Host stand-in for <infos/fs/block-based-filesystem.h>
+ */
+#ifndef TEST_INFOS_FS_BLOCK_BASED_FILESYSTEM_H
+#define TEST_INFOS_FS_BLOCK_BASED_FILESYSTEM_H
+
+#include <infos/fs/filesystem.h>
+#include <infos/drivers/block/block-device.h>
+
+namespace infos {
+	namespace fs {
+		class BlockBasedFilesystem : public Filesystem {
+		public:
+			BlockBasedFilesystem(drivers::block::BlockDevice& bdev) : _bdev(bdev) { }
+
+			drivers::block::BlockDevice& block_device() const { return _bdev; }
+
+		private:
+			drivers::block::BlockDevice& _bdev;
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,26 @@
+/*
+ * Host stand-in for <infos/fs/directory.h>
+ */
+#ifndef TEST_INFOS_FS_DIRECTORY_H
+#define TEST_INFOS_FS_DIRECTORY_H
+
+#include <infos/util/string.h>
+
+namespace infos {
+	namespace fs {
+		struct DirectoryEntry {
+			util::String name;
+			unsigned int size;
+		};
+
+		class Directory {
+		public:
+			virtual ~Directory() { }
+
+			virtual bool read_entry(DirectoryEntry& entry) = 0;
+			virtual void close() = 0;
+		};
+	}
+}
+
+#endif
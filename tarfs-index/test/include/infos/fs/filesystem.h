@@ -0,0 +1,32 @@
+/*
+ * Host stand-in for <infos/fs/filesystem.h>
+ */
+#ifndef TEST_INFOS_FS_FILESYSTEM_H
+#define TEST_INFOS_FS_FILESYSTEM_H
+
+#include <infos/util/string.h>
+#include <infos/drivers/device.h>
+
+namespace infos {
+	namespace fs {
+		class PFSNode;
+		class VirtualFilesystem;
+
+		class Filesystem {
+		public:
+			virtual ~Filesystem() { }
+
+			virtual PFSNode *mount() = 0;
+			virtual const util::String name() const = 0;
+		};
+
+		typedef Filesystem *(*FilesystemFactory)(VirtualFilesystem& vfs, drivers::Device *dev);
+	}
+}
+
+// The test creates the file-system directly, so the factory is only kept, not
+// registered anywhere.
+#define RegisterFilesystem(_name, _factory) \
+	__attribute__((unused)) static infos::fs::FilesystemFactory __fs_factory_##_name = _factory
+
+#endif
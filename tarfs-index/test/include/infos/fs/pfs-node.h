@@ -0,0 +1,33 @@
+/*
+ * Host stand-in for <infos/fs/pfs-node.h>
+ */
+#ifndef TEST_INFOS_FS_PFS_NODE_H
+#define TEST_INFOS_FS_PFS_NODE_H
+
+#include <infos/fs/filesystem.h>
+#include <infos/fs/file.h>
+#include <infos/fs/directory.h>
+
+namespace infos {
+	namespace fs {
+		class PFSNode {
+		public:
+			PFSNode(PFSNode *parent, Filesystem& owner) : _parent(parent), _owner(owner) { }
+			virtual ~PFSNode() { }
+
+			PFSNode *parent() const { return _parent; }
+			Filesystem& owner() const { return _owner; }
+
+			virtual File *open() = 0;
+			virtual Directory *opendir() = 0;
+			virtual PFSNode *get_child(const util::String& name) = 0;
+			virtual PFSNode *mkdir(const util::String& name) = 0;
+
+		private:
+			PFSNode *_parent;
+			Filesystem& _owner;
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * Host stand-in for <infos/kernel/kernel.h>
+ */
+#ifndef TEST_INFOS_KERNEL_KERNEL_H
+#define TEST_INFOS_KERNEL_KERNEL_H
+
+#include <infos/util/time.h>
+#include <infos/mm/mm.h>
+
+namespace infos {
+	namespace kernel {
+		/**
+		 * The kernel, which provides the host's clock and memory.
+		 */
+		class Kernel {
+		public:
+			util::Nanoseconds runtime() const;
+
+			mm::MemoryManager& mm() { return _mm; }
+
+		private:
+			mm::MemoryManager _mm;
+		};
+
+		extern Kernel sys;
+	}
+}
+
+#endif
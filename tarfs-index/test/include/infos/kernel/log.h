@@ -0,0 +1,40 @@
+/*
+ * Host stand-in for <infos/kernel/log.h>
+ */
+#ifndef TEST_INFOS_KERNEL_LOG_H
+#define TEST_INFOS_KERNEL_LOG_H
+
+#include <infos/define.h>
+
+namespace infos {
+	namespace kernel {
+		namespace LogLevel {
+			enum LogLevel {
+				DEBUG,
+				INFO,
+				NOTICE,
+				WARNING,
+				ERROR,
+				FATAL
+			};
+		}
+
+		/**
+		 * A log, whose messages the test keeps, so that it can check what the
+		 * file-system reported.
+		 */
+		class ComponentLog {
+		public:
+			ComponentLog(const char *component) : _component(component) { }
+
+			void messagef(LogLevel::LogLevel level, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+		private:
+			const char *_component;
+		};
+
+		extern ComponentLog syslog;
+	}
+}
+
+#endif
@@ -0,0 +1,21 @@
+/*
+ * Host stand-in for <infos/mm/mm.h>
+ */
+#ifndef TEST_INFOS_MM_MM_H
+#define TEST_INFOS_MM_MM_H
+
+#include <infos/mm/page-allocator.h>
+
+namespace infos {
+	namespace mm {
+		class MemoryManager {
+		public:
+			PageAllocator& pgalloc() { return _pgalloc; }
+
+		private:
+			PageAllocator _pgalloc;
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,32 @@
+/*
+ * Host stand-in for <infos/mm/page-allocator.h>
+ */
+#ifndef TEST_INFOS_MM_PAGE_ALLOCATOR_H
+#define TEST_INFOS_MM_PAGE_ALLOCATOR_H
+
+#include <infos/define.h>
+
+namespace infos {
+	namespace mm {
+		/**
+		 * Describes a block of pages, which the host allocates in one piece.
+		 */
+		struct PageDescriptor {
+			void *base;
+		};
+
+		/**
+		 * The page allocator, which hands out power of two numbers of pages from the
+		 * host's heap.
+		 */
+		class PageAllocator {
+		public:
+			PageDescriptor *alloc_pages(int order);
+			void free_pages(PageDescriptor *pgd, int order);
+
+			void *pgd_to_vpa(const PageDescriptor *pgd) const { return pgd->base; }
+		};
+	}
+}
+
+#endif
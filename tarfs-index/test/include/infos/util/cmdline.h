@@ -0,0 +1,33 @@
+/*
+ * Host stand-in for <infos/util/cmdline.h>
+ *
+ * Command-line arguments are collected into a registry, so that the test can set the
+ * file-system's options between mounts.
+ */
+#ifndef TEST_INFOS_UTIL_CMDLINE_H
+#define TEST_INFOS_UTIL_CMDLINE_H
+
+namespace test {
+	typedef void (*CmdLineHandler)(const char *value);
+
+	struct CmdLineArgument {
+		CmdLineArgument(const char *key, CmdLineHandler handler);
+
+		const char *key;
+		CmdLineHandler handler;
+		CmdLineArgument *next;
+	};
+
+	/**
+	 * Passes a value to the handler registered for a key.
+	 * @return Returns FALSE if no handler is registered for the key.
+	 */
+	extern bool set_option(const char *key, const char *value);
+}
+
+#define RegisterCmdLineArgument(_name, _key) \
+	static void __cmdline_handler_##_name(const char *value); \
+	static test::CmdLineArgument __cmdline_arg_##_name(_key, __cmdline_handler_##_name); \
+	static void __cmdline_handler_##_name(const char *value)
+
+#endif
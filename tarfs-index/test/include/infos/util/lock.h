@@ -0,0 +1,29 @@
+/*
+ * Host stand-in for <infos/util/lock.h>
+ *
+ * The test mounts and reads from a single thread, so locks do nothing.
+ */
+#ifndef TEST_INFOS_UTIL_LOCK_H
+#define TEST_INFOS_UTIL_LOCK_H
+
+namespace infos {
+	namespace util {
+		class Mutex {
+		public:
+			void lock() { }
+			void unlock() { }
+		};
+
+		template<typename T>
+		class UniqueLock {
+		public:
+			UniqueLock(T& lock) : _lock(lock) { _lock.lock(); }
+			~UniqueLock() { _lock.unlock(); }
+
+		private:
+			T& _lock;
+		};
+	}
+}
+
+#endif
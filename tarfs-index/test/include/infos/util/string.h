@@ -0,0 +1,34 @@
+/*
+ * Host stand-in for <infos/util/string.h>
+ */
+#ifndef TEST_INFOS_UTIL_STRING_H
+#define TEST_INFOS_UTIL_STRING_H
+
+#include <string.h>
+#include <string>
+
+namespace infos {
+	namespace util {
+		using ::strlen;
+		using ::strncmp;
+		using ::memcpy;
+		using ::memset;
+
+		/**
+		 * A string, which the host keeps in a std::string.
+		 */
+		class String {
+		public:
+			String() { }
+			String(const char *str) : _str(str) { }
+
+			const char *c_str() const { return _str.c_str(); }
+			unsigned int length() const { return _str.length(); }
+
+		private:
+			std::string _str;
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * Host stand-in for <infos/util/time.h>
+ */
+#ifndef TEST_INFOS_UTIL_TIME_H
+#define TEST_INFOS_UTIL_TIME_H
+
+#include <infos/define.h>
+
+namespace infos {
+	namespace util {
+		/**
+		 * A duration, measured in nanoseconds.
+		 */
+		class Nanoseconds {
+		public:
+			Nanoseconds() : _count(0) { }
+			Nanoseconds(uint64_t count) : _count(count) { }
+
+			uint64_t count() const { return _count; }
+
+			Nanoseconds operator-(const Nanoseconds& other) const { return Nanoseconds(_count - other._count); }
+
+		private:
+			uint64_t _count;
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,423 @@
+/*
+ * tarfs Index Round-trip Test
+ *
+ * Builds a TAR archive, indexes it with the tarfs-index tool, and mounts it with the
+ * real tarfs driver from ../coursework, against stand-in kernel headers (see
+ * include/).  The mount must use the index, and find every member of the archive with
+ * the right contents.  The index is then damaged, first in the trailer's checksum and
+ * then in the table itself, and each time the mount must reject the index and scan the
+ * archive instead, with the same results.  Every mount is made both eagerly and
+ * lazily.
+ *
+ * Usage: mount-test <tarfs-index> <scratch-archive>
+ *
+ * The exit status is zero if every check passed.
+ */
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/log.h>
+#include <infos/util/cmdline.h>
+
+#include "tarfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+using namespace infos::kernel;
+using namespace infos::drivers;
+using namespace infos::drivers::block;
+using namespace infos::fs;
+using namespace infos::mm;
+using namespace infos::util;
+
+#define BLOCK_SIZE	512
+
+/* --- Stand-in kernel definitions --- */
+
+Kernel infos::kernel::sys;
+ComponentLog infos::kernel::syslog("syslog");
+
+const DeviceClass BlockDevice::BlockDeviceClass(NULL);
+
+// Everything logged since the last mount began.
+static std::string mount_log;
+
+void ComponentLog::messagef(LogLevel::LogLevel level, const char *format, ...)
+{
+	char message[512];
+
+	va_list args;
+	va_start(args, format);
+	vsnprintf(message, sizeof(message), format, args);
+	va_end(args);
+
+	mount_log += message;
+	mount_log += '\n';
+}
+
+Nanoseconds Kernel::runtime() const
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return Nanoseconds(((uint64_t) ts.tv_sec * 1000000000ULL) + ts.tv_nsec);
+}
+
+PageDescriptor *PageAllocator::alloc_pages(int order)
+{
+	void *base = aligned_alloc(__page_size, (size_t) __page_size << order);
+	if (!base) return NULL;
+
+	return new PageDescriptor { base };
+}
+
+void PageAllocator::free_pages(PageDescriptor *pgd, int order)
+{
+	free(pgd->base);
+	delete pgd;
+}
+
+static test::CmdLineArgument *cmdline_arguments;
+
+test::CmdLineArgument::CmdLineArgument(const char *key, CmdLineHandler handler)
+	: key(key), handler(handler), next(cmdline_arguments)
+{
+	cmdline_arguments = this;
+}
+
+bool test::set_option(const char *key, const char *value)
+{
+	for (CmdLineArgument *a = cmdline_arguments; a; a = a->next) {
+		if (strcmp(a->key, key) == 0) {
+			a->handler(value);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * A block device over an archive image held in memory.
+ */
+class MemoryBlockDevice : public BlockDevice {
+public:
+	MemoryBlockDevice(const std::vector<uint8_t>& image) : _image(image) { }
+
+	bool read_blocks(void *buffer, size_t offset, size_t count) override
+	{
+		if (offset + count > block_count()) return false;
+
+		memcpy(buffer, &_image[offset * BLOCK_SIZE], count * BLOCK_SIZE);
+		return true;
+	}
+
+	bool write_blocks(const void *buffer, size_t offset, size_t count) override { return false; }
+
+	size_t block_size() const override { return BLOCK_SIZE; }
+	size_t block_count() const override { return _image.size() / BLOCK_SIZE; }
+
+private:
+	const std::vector<uint8_t>& _image;
+};
+
+/* --- The archive --- */
+
+/**
+ * A member of the test archive.  Directories have paths ending in a slash.
+ */
+struct Member {
+	std::string path;
+	std::string data;
+
+	bool is_directory() const { return path.back() == '/'; }
+};
+
+static std::vector<Member> members;
+
+/**
+ * Fills in a numeric TAR header field, in octal, padded with zeroes.
+ */
+static void put_octal(char *field, size_t size, unsigned long value)
+{
+	snprintf(field, size, "%0*lo", (int) size - 1, value);
+}
+
+/**
+ * Appends a member, with its header, to an archive image.
+ */
+static void append_member(std::vector<uint8_t>& image, const Member& member)
+{
+	uint8_t header[BLOCK_SIZE];
+	memset(header, 0, sizeof(header));
+
+	// Paths too long for the name field are split at a slash, with the start of the
+	// path in the prefix field.
+	std::string path = member.path, prefix;
+	if (path.size() > 100) {
+		size_t split = path.rfind('/', path.size() - 2);
+		prefix = path.substr(0, split);
+		path = path.substr(split + 1);
+	}
+
+	memcpy(&header[0], path.data(), path.size());
+	put_octal((char *) &header[100], 8, member.is_directory() ? 0755 : 0644);
+	put_octal((char *) &header[108], 8, 0);
+	put_octal((char *) &header[116], 8, 0);
+	put_octal((char *) &header[124], 12, member.data.size());
+	put_octal((char *) &header[136], 12, 0);
+	header[156] = member.is_directory() ? '5' : '0';
+	memcpy(&header[257], "ustar", 6);
+	memcpy(&header[263], "00", 2);
+	memcpy(&header[345], prefix.data(), prefix.size());
+
+	// The checksum is taken with the checksum field itself filled with spaces.
+	memset(&header[148], ' ', 8);
+	unsigned long checksum = 0;
+	for (unsigned int i = 0; i < BLOCK_SIZE; i++) checksum += header[i];
+	snprintf((char *) &header[148], 8, "%06lo", checksum);
+
+	image.insert(image.end(), header, header + BLOCK_SIZE);
+	image.insert(image.end(), member.data.begin(), member.data.end());
+	image.resize(((image.size() + BLOCK_SIZE - 1) / BLOCK_SIZE) * BLOCK_SIZE, 0);
+}
+
+/**
+ * Makes up the members of the test archive: a few directories, files of awkward
+ * sizes, a path that needs the prefix field, and enough files that the index table
+ * takes several blocks.
+ */
+static void make_members()
+{
+	static const char *directories[] = { "bin/", "usr/", "usr/share/", "usr/lib/" };
+	for (const char *dir : directories) members.push_back({ dir, "" });
+
+	members.push_back({ "bin/init", std::string(3000, 'i') });
+	members.push_back({ "usr/empty", "" });
+	members.push_back({ "usr/exact", std::string(BLOCK_SIZE, 'e') });
+
+	std::string deep = "usr/share/";
+	for (int i = 0; i < 4; i++) {
+		deep += std::string(30, 'a' + i) + "/";
+		members.push_back({ deep, "" });
+	}
+	members.push_back({ deep + "file", "at the bottom" });
+
+	for (int i = 0; i < 60; i++) {
+		std::string data;
+		for (int j = 0; j < i * 97; j++) data += (char) ('a' + ((i + j) % 26));
+		members.push_back({ "usr/lib/lib" + std::to_string(i) + ".so", data });
+	}
+}
+
+/**
+ * Writes the test archive, and runs the index tool over it.
+ * @return Returns the indexed archive, or an empty image if the tool failed.
+ */
+static std::vector<uint8_t> build_indexed_archive(const char *tool, const char *path)
+{
+	std::vector<uint8_t> image;
+	for (const Member& member : members) append_member(image, member);
+	image.resize(image.size() + (2 * BLOCK_SIZE), 0);
+
+	FILE *f = fopen(path, "wb");
+	if (!f || fwrite(image.data(), 1, image.size(), f) != image.size()) {
+		perror(path);
+		if (f) fclose(f);
+		return std::vector<uint8_t>();
+	}
+	fclose(f);
+
+	std::string command = std::string(tool) + " " + path + " >/dev/null";
+	if (system(command.c_str()) != 0) {
+		fprintf(stderr, "%s: failed\n", command.c_str());
+		return std::vector<uint8_t>();
+	}
+
+	image.clear();
+
+	f = fopen(path, "rb");
+	if (!f) {
+		perror(path);
+		return image;
+	}
+
+	uint8_t buffer[65536];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+		image.insert(image.end(), buffer, buffer + n);
+	}
+	fclose(f);
+
+	return image;
+}
+
+/* --- The checks --- */
+
+static int nr_failures;
+
+static void fail(const char *test, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static void fail(const char *test, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+
+	fprintf(stderr, "FAIL %s: ", test);
+	vfprintf(stderr, format, args);
+	fprintf(stderr, "\n");
+
+	va_end(args);
+	nr_failures++;
+}
+
+/**
+ * Walks a path from the root of a mounted file-system.
+ */
+static PFSNode *lookup(PFSNode *root, const std::string& path)
+{
+	PFSNode *node = root;
+
+	size_t start = 0;
+	while (node && start < path.size()) {
+		size_t end = path.find('/', start);
+		if (end == std::string::npos) end = path.size();
+
+		if (end > start) node = node->get_child(path.substr(start, end - start).c_str());
+		start = end + 1;
+	}
+
+	return node;
+}
+
+/**
+ * Mounts an archive image, and checks that it was mounted in the expected way, and that
+ * every member of the archive is there with the right contents.
+ * @param test The name of the test, for reporting failures.
+ * @param image The archive image to mount.
+ * @param from_index Whether the mount should use the index, rather than scan.
+ * @param expect A message the mount is expected to log, or NULL.
+ */
+static void check_mount(const char *test, const std::vector<uint8_t>& image, bool from_index, const char *expect)
+{
+	MemoryBlockDevice bdev(image);
+	tarfs::TarFS *fs = new tarfs::TarFS(bdev);
+
+	mount_log.clear();
+	PFSNode *root = fs->mount();
+
+	if (!root) {
+		fail(test, "the mount failed");
+		delete fs;
+		return;
+	}
+
+	if ((mount_log.find("from index") != std::string::npos) != from_index) {
+		fail(test, "the archive was %s, not %s", from_index ? "scanned" : "mounted from its index",
+			from_index ? "mounted from its index" : "scanned");
+	}
+
+	if (expect && mount_log.find(expect) == std::string::npos) {
+		fail(test, "expected \"%s\" in the log, which was:\n%s", expect, mount_log.c_str());
+	}
+
+	for (const Member& member : members) {
+		PFSNode *node = lookup(root, member.path);
+		if (!node) {
+			fail(test, "%s is missing", member.path.c_str());
+			continue;
+		}
+
+		if (member.is_directory()) {
+			// Every member directly inside the directory must be listed.
+			unsigned int expected = 0;
+			for (const Member& other : members) {
+				if (other.path.size() <= member.path.size() || other.path.compare(0, member.path.size(), member.path) != 0) continue;
+
+				size_t slash = other.path.find('/', member.path.size());
+				if (slash == std::string::npos || slash == other.path.size() - 1) expected++;
+			}
+
+			Directory *dir = node->opendir();
+			DirectoryEntry entry;
+			unsigned int listed = 0;
+			while (dir->read_entry(entry)) listed++;
+			dir->close();
+			delete dir;
+
+			if (listed != expected) fail(test, "%s lists %u entries, not %u", member.path.c_str(), listed, expected);
+			continue;
+		}
+
+		File *file = node->open();
+		std::string data;
+		char buffer[1000];
+		int n;
+		while ((n = file->read(buffer, sizeof(buffer))) > 0) data.append(buffer, n);
+		file->close();
+		delete file;
+
+		if (data != member.data) fail(test, "%s reads back wrongly (%zu bytes, not %zu)", member.path.c_str(), data.size(), member.data.size());
+	}
+
+	if (lookup(root, "usr/nonexistent")) fail(test, "usr/nonexistent was found");
+
+	delete fs;
+}
+
+/**
+ * Checks the mount of an archive image, both eagerly and lazily.
+ */
+static void check_mounts(const char *test, const std::vector<uint8_t>& image, bool from_index, const char *expect)
+{
+	std::string name(test);
+
+	test::set_option("tarfs.lazy", "0");
+	check_mount((name + " (eager)").c_str(), image, from_index, expect);
+
+	test::set_option("tarfs.lazy", "1");
+	check_mount((name + " (lazy)").c_str(), image, from_index, expect);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s <tarfs-index> <scratch-archive>\n", argv[0]);
+		return 1;
+	}
+
+	make_members();
+
+	std::vector<uint8_t> image = build_indexed_archive(argv[1], argv[2]);
+	if (image.empty()) return 1;
+
+	tarfs::tarfs_index_trailer *trailer = (tarfs::tarfs_index_trailer *) &image[image.size() - BLOCK_SIZE];
+	if (strncmp(trailer->magic, TARFS_INDEX_MAGIC, TARFS_INDEX_MAGIC_SIZE) != 0) {
+		fprintf(stderr, "%s: the archive has no index\n", argv[2]);
+		return 1;
+	}
+
+	check_mounts("indexed", image, true, NULL);
+
+	// A bad checksum in the trailer, and a damaged table, must both make the mount
+	// fall back to scanning the archive.
+	trailer->checksum ^= 1;
+	check_mounts("bad checksum", image, false, "ignoring index with bad checksum");
+	trailer->checksum ^= 1;
+
+	image[(trailer->table_block * BLOCK_SIZE) + trailer->table_size - 1] ^= 0x20;
+	check_mounts("damaged table", image, false, "ignoring index with bad checksum");
+
+	if (nr_failures) {
+		fprintf(stderr, "%d checks failed\n", nr_failures);
+		return 1;
+	}
+
+	printf("all checks passed\n");
+	return 0;
+}